@@ -0,0 +1,143 @@
+/*
+ * bench_stats.c - summary statistics of repeated benchmark runs and
+ *                 histograms of per-op latencies for test_heap.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_stats.h"
+
+/** Two-sided 95% critical values of Student's t for 1 to 30 degrees of freedom */
+static const double t95[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/**
+ * Find the bucket of a latency.
+ * @param ns the latency
+ * @return the bucket
+ */
+static int latency_bucket(uint64_t ns) {
+	if (ns < LATENCY_SUB) {
+		return ns;
+	}
+	int e = 63 - __builtin_clzll(ns);          /* ns is in [2^e, 2^(e+1)) */
+	return (e - 3) * LATENCY_SUB + ((ns >> (e - 4)) & (LATENCY_SUB - 1));
+}
+
+/**
+ * Find the smallest latency in a bucket.
+ * @param bucket the bucket
+ * @return the latency
+ */
+static uint64_t bucket_latency(int bucket) {
+	if (bucket < LATENCY_SUB) {
+		return bucket;
+	}
+	int e = bucket / LATENCY_SUB + 3;
+	return (uint64_t)(LATENCY_SUB + bucket % LATENCY_SUB) << (e - 4);
+}
+
+/**
+ * Record a latency.
+ *
+ * @param hist the histogram
+ * @param ns the latency in ns
+ */
+void latency_record(LatencyHist *hist, uint64_t ns) {
+	hist->counts[latency_bucket(ns)]++;
+	hist->total++;
+	if (ns > hist->max) {
+		hist->max = ns;
+	}
+}
+
+/**
+ * Add the latencies of one histogram to another.
+ *
+ * @param to the histogram added to
+ * @param from the histogram added
+ */
+void latency_merge(LatencyHist *to, const LatencyHist *from) {
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		to->counts[i] += from->counts[i];
+	}
+	to->total += from->total;
+	if (from->max > to->max) {
+		to->max = from->max;
+	}
+}
+
+/**
+ * Find a percentile of the recorded latencies.
+ *
+ * @param hist the histogram
+ * @param p the percentile, from 0 to 100
+ * @return the lower bound of the bucket of the percentile, 0 if there are no latencies
+ */
+uint64_t latency_percentile(const LatencyHist *hist, double p) {
+	if (hist->total == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)ceil(p / 100.0 * hist->total);
+	if (rank == 0) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			return bucket_latency(i);
+		}
+	}
+	return hist->max;
+}
+
+/**
+ * Order doubles for qsort.
+ * @param a the first double
+ * @param b the second double
+ * @return negative, zero or positive as a is less than, equal to or greater than b
+ */
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Summarize a set of samples, using Student's t for the confidence
+ * interval so that it holds for a few repetitions.
+ *
+ * @param stats set to the summary
+ * @param samples the samples, sorted in place
+ * @param n the number of samples
+ */
+void sample_stats(SampleStats *stats, double *samples, int n) {
+	memset(stats, 0, sizeof(*stats));
+	stats->n = n;
+	if (n == 0) {
+		return;
+	}
+	qsort(samples, n, sizeof(double), compare_doubles);
+	stats->min = samples[0];
+	stats->max = samples[n-1];
+	stats->median = (n % 2) ? samples[n/2] : (samples[n/2-1] + samples[n/2]) / 2;
+	double sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += samples[i];
+	}
+	stats->mean = sum / n;
+	if (n > 1) {
+		double squares = 0;
+		for (int i = 0; i < n; i++) {
+			squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+		}
+		stats->stddev = sqrt(squares / (n - 1));
+		double t = (n - 1 <= (int)(sizeof(t95)/sizeof(t95[0]))) ? t95[n-2] : 1.960;
+		stats->ci95 = t * stats->stddev / sqrt(n);
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * bench_stats.h - summary statistics of repeated benchmark runs and
+ *                 histograms of per-op latencies for test_heap.
+ *
+ * A latency histogram has exact buckets below LATENCY_SUB ns and then
+ * LATENCY_SUB buckets per power of two, so a percentile is within about
+ * 6% of the latency it stands for, whatever its magnitude.
+ */
+
+#ifndef BENCH_STATS_H_
+#define BENCH_STATS_H_
+
+#include <stdint.h>
+
+/** Buckets per power of two in a latency histogram */
+#define LATENCY_SUB 16
+
+/** Buckets in a latency histogram, enough for any 64-bit latency */
+#define LATENCY_BUCKETS (61 * LATENCY_SUB)
+
+/** A histogram of latencies in ns */
+typedef struct {
+	uint64_t counts[LATENCY_BUCKETS];       /* latencies in each bucket */
+	uint64_t total;                         /* latencies recorded */
+	uint64_t max;                           /* largest latency recorded */
+} LatencyHist;
+
+/** Summary of a set of samples */
+typedef struct {
+	int n;                                  /* number of samples */
+	double median;
+	double min;
+	double max;
+	double mean;
+	double stddev;                          /* sample standard deviation */
+	double ci95;                            /* half width of the 95% confidence interval of the mean */
+} SampleStats;
+
+/**
+ * Record a latency.
+ *
+ * @param hist the histogram
+ * @param ns the latency in ns
+ */
+void latency_record(LatencyHist *hist, uint64_t ns);
+
+/**
+ * Add the latencies of one histogram to another.
+ *
+ * @param to the histogram added to
+ * @param from the histogram added
+ */
+void latency_merge(LatencyHist *to, const LatencyHist *from);
+
+/**
+ * Find a percentile of the recorded latencies.
+ *
+ * @param hist the histogram
+ * @param p the percentile, from 0 to 100
+ * @return the lower bound of the bucket of the percentile, 0 if there are no latencies
+ */
+uint64_t latency_percentile(const LatencyHist *hist, double p);
+
+/**
+ * Summarize a set of samples, using Student's t for the confidence
+ * interval so that it holds for a few repetitions.
+ *
+ * @param stats set to the summary
+ * @param samples the samples, sorted in place
+ * @param n the number of samples
+ */
+void sample_stats(SampleStats *stats, double *samples, int n);
+
+#endif /* BENCH_STATS_H_ */
@@ -0,0 +1,162 @@
+/*
+ * heap_map.c - render heap snapshots written by mm_heap_snapshot
+ *
+ * Prints one line per snapshot with the heap size, allocated, free and
+ * parked bytes, the number of free blocks, the largest free block, the
+ * fragmentation (1 - largest free block / free bytes), and a map of the
+ * heap where each character shows how full its part of the heap is.
+ * A snapshot whose tag does not increase starts a new series, as when
+ * test_heap moves on to the next trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "mm_heap.h"
+
+/** Default number of characters in the heap map */
+#define MAP_WIDTH 64
+
+/** Characters of the heap map by allocated fraction */
+static const char map_chars[] = " .:-=+*#";
+
+/**
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: heap_map [-h] [-w <width>] <file>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-w <width> Characters in the heap map (default %d).\n", MAP_WIDTH);
+    fprintf(stderr, "\t<file>     Snapshots written by test_heap -m.\n");
+}
+
+/**
+ * Render one snapshot.
+ * @param header the snapshot header
+ * @param blocks the blocks of the snapshot
+ * @param width the number of characters in the heap map
+ */
+static void render(const MMSnapshotHeader *header, const MMSnapshotBlock *blocks, int width) {
+	uint64_t alloc = 0, freeb = 0, parked = 0, largest = 0;
+	uint64_t nfree = 0;
+	double used[width];
+	memset(used, 0, sizeof(used));
+	double cell = (header->heapsize > 0) ? (double)header->heapsize / width : 1;
+
+	for (uint64_t i = 0; i < header->nblocks; i++) {
+		const MMSnapshotBlock *b = &blocks[i];
+		if (b->state == MM_BLOCK_FREE) {
+			freeb += b->size;
+			nfree++;
+			largest = (b->size > largest) ? b->size : largest;
+			continue;
+		}
+		if (b->state == MM_BLOCK_PARKED) {
+			parked += b->size;
+		} else {
+			alloc += b->size;
+		}
+		/* spread the block over the cells it covers */
+		double start = b->offset, end = b->offset + b->size;
+		for (int c = (int)(start / cell); c < width && c * cell < end; c++) {
+			double lo = (c * cell > start) ? c * cell : start;
+			double hi = ((c + 1) * cell < end) ? (c + 1) * cell : end;
+			used[c] += (hi - lo) / cell;
+		}
+	}
+
+	char map[width + 1];
+	for (int c = 0; c < width; c++) {
+		int level = (int)(used[c] * (sizeof(map_chars) - 1));
+		if (level > (int)sizeof(map_chars) - 2) {
+			level = sizeof(map_chars) - 2;
+		} else if (level == 0 && used[c] > 0) {
+			level = 1;
+		}
+		map[c] = map_chars[level];
+	}
+	map[width] = '\0';
+
+	double frag = (freeb > 0) ? 1.0 - (double)largest / freeb : 0.0;
+	printf("%9llu%9llu%9llu%9llu%9llu%9llu%10llu%6.2f  |%s|\n",
+			(unsigned long long)header->tag, (unsigned long long)header->heapsize/1024,
+			(unsigned long long)alloc/1024, (unsigned long long)freeb/1024,
+			(unsigned long long)parked/1024, (unsigned long long)nfree,
+			(unsigned long long)largest/1024, frag, map);
+}
+
+/**
+ * Program renders heap snapshots.
+ * @param argc the argument count
+ * @param argv the argument array
+ */
+int main(int argc, char *argv[]) {
+	int c;
+	int width = MAP_WIDTH;
+	while ((c = getopt(argc, argv, "hw:")) != EOF) {
+		switch (c) {
+		case 'w': /* Characters in the heap map */
+			width = atoi(optarg);
+			if (width <= 0) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h': /* Print this message */
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	FILE *in = fopen(argv[optind], "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Missing snapshot file: %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	MMSnapshotHeader header;
+	MMSnapshotBlock *blocks = NULL;
+	size_t capacity = 0;
+	int series = 0;
+	uint64_t last_tag = 0;
+	while (fread(&header, sizeof(header), 1, in) == 1) {
+		if (memcmp(header.magic, MM_SNAPSHOT_MAGIC, sizeof(MM_SNAPSHOT_MAGIC)) != 0) {
+			fprintf(stderr, "Invalid snapshot in %s\n", argv[optind]);
+			break;
+		}
+		if (header.nblocks > capacity) {
+			capacity = header.nblocks;
+			free(blocks);
+			blocks = malloc(capacity * sizeof(MMSnapshotBlock));
+			if (blocks == NULL) {
+				fprintf(stderr, "Snapshot of %llu blocks too large\n", (unsigned long long)header.nblocks);
+				break;
+			}
+		}
+		if (fread(blocks, sizeof(MMSnapshotBlock), header.nblocks, in) != header.nblocks) {
+			fprintf(stderr, "Truncated snapshot in %s\n", argv[optind]);
+			break;
+		}
+		if (series == 0 || header.tag <= last_tag) {
+			printf("%sseries %d\n", (series > 0) ? "\n" : "", series + 1);
+			series++;
+			printf("%9s%9s%9s%9s%9s%9s%10s%6s  %s\n",
+					"tag", "heapKB", "allocKB", "freeKB", "parkedKB", "freeblks", "largestKB", "frag", "map");
+		}
+		last_tag = header.tag;
+		render(&header, blocks, width);
+	}
+	free(blocks);
+	fclose(in);
+	return EXIT_SUCCESS;
+}
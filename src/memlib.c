@@ -2,47 +2,442 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The model can hold several independent heap regions, e.g. one
+ *            per NUMA node. The mem_ heap functions act on the region the
+ *            calling thread selected with mem_region_select, initially the
+ *            default region.
+ *
+ *            Each region reserves address space for its maximum heap
+ *            size, MAX_HEAP unless set at run time, which can be many
+ *            GB; memory backs only the pages the heap grows over.
+ *
+ *            A region can also be mapped from a file, a memfd or a shared
+ *            memory object. Its brk is kept in a header page at the start
+ *            of the mapping, so the heap survives remapping, at whatever
+ *            address, and can be shared by several processes.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
-//#include <sys/mman.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <string.h>
 #include <errno.h>
 
 #include "memlib.h"
 /*
- * Default maximum heap size in bytes
+ * Default maximum heap size in bytes, overridden at run time by
+ * mem_set_max_heap or the MM_MAX_HEAP environment variable
  */
 #ifndef MAX_HEAP
-#define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#define MAX_HEAP ((size_t)20*(1<<20))  /* 20 MB */
+#endif
+
+/*
+ * Huge page size used to align and commit a huge page heap
+ */
+#ifndef HUGE_PAGE
+#define HUGE_PAGE (2*(1<<20))  /* 2 MB */
 #endif
 
+/* rounds up to the nearest multiple of HUGE_PAGE */
+#define HUGE_ALIGN(size) (((size) + (HUGE_PAGE-1)) & ~((size_t)HUGE_PAGE-1))
+
+/*
+ * Largest number of NUMA nodes supported
+ */
+#ifndef MEM_MAX_NODES
+#define MEM_MAX_NODES 64
+#endif
+
+/* mbind policy binding memory to a set of nodes (see numaif.h) */
+#define MEM_MPOL_BIND 2
+
+/*
+ * Bytes at the start of a mapped region before its heap
+ */
+#define MEM_MAP_HEADER 4096
+
+/* identifies the header of a mapped region */
+#define MEM_MAP_MAGIC "MEMMAP1"
+
+/** Header at the start of a mapped region */
+typedef struct {
+	char magic[8];                      /* MEM_MAP_MAGIC */
+	uint64_t map_len;                   /* bytes in the mapping */
+	uint64_t brk;                       /* bytes in the heap */
+	unsigned char user[MEM_MAP_USER];   /* kept for the user of the region */
+} MemMapHeader;
+
+/** A heap region */
+struct MemRegion {
+	/** points to first byte of heap */
+	void *start_brk;
+
+	/** points to last byte of heap */
+	void *brk;
+
+	/** largest legal heap address */
+	void *max_addr;
+
+	/** how the heap is backed */
+	MemPages pages;
+
+	/** start and length of the mapping holding the heap */
+	void *map_start;
+	size_t map_len;
+
+	/** end of the committed (accessible) part of a transparent huge page heap */
+	char *commit_brk;
+
+	/** end of the part of a restored heap still mapped from its file, NULL if none */
+	char *file_brk;
+
+	/** NUMA node the heap memory is bound to, -1 if not bound */
+	int node;
+
+	/** header holding the brk of a mapped region, NULL if not mapped */
+	MemMapHeader *shared;
+};
+
 /* private variables */
-/** points to first byte of heap */
-static void *mem_start_brk = NULL;
+/** the default region */
+static MemRegion mem_default = { .node = -1 };
+
+/** region used by the calling thread */
+static __thread MemRegion *mem = &mem_default;
+
+/** huge pages requested for the next mem_init */
+static int mem_hugepages_wanted = 0;
+
+/** bytes reserved for each region created from now on, 0 until first used */
+static size_t mem_max_bytes = 0;
+
+/** bytes in the heaps of all regions not mapped by mem_region_map */
+static size_t mem_total_bytes = 0;
+
+/** largest mem_total_bytes since the last mem_reset_peak */
+static size_t mem_peak_bytes = 0;
+
+/**
+ * mem_account - add a change in the heap size of a region to the total
+ *    over all regions and raise the high-water mark. Mapped regions are
+ *    left out, since other processes move their brk.
+ *
+ * @param r the region
+ * @param incr the bytes the heap grew by, negative if it shrank
+ */
+static void mem_account(MemRegion *r, ptrdiff_t incr) {
+	if (r->shared != NULL || incr == 0) {
+		return;
+	}
+	size_t total = __atomic_add_fetch(&mem_total_bytes, (size_t)incr, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
+	while (total > peak && !__atomic_compare_exchange_n(&mem_peak_bytes, &peak, total, 1,
+														__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+/**
+ * mem_reserve_size - returns the bytes to reserve for a heap: the size
+ *    set by mem_set_max_heap, else MM_MAX_HEAP from the environment
+ *    (with an optional K, M or G suffix), else MAX_HEAP. A value with
+ *    other trailing characters or that overflows gives MAX_HEAP.
+ *
+ * @return the bytes to reserve
+ */
+static size_t mem_reserve_size(void) {
+	if (mem_max_bytes == 0) {
+		mem_max_bytes = MAX_HEAP;
+		const char *env = getenv("MM_MAX_HEAP");
+		if (env == NULL || *env < '0' || *env > '9') {
+			return mem_max_bytes;      /* unset, or no digits, sign or space first */
+		}
+		char *end;
+		int saved_errno = errno;
+		errno = 0;
+		unsigned long long bytes = strtoull(env, &end, 10);
+		int shift = 0;
+		switch (*end) {
+		case 'G': case 'g': shift = 30; end++; break;
+		case 'M': case 'm': shift = 20; end++; break;
+		case 'K': case 'k': shift = 10; end++; break;
+		}
+		/* reject trailing characters and sizes that overflow */
+		if (errno == 0 && *end == '\0' && bytes > 0 && bytes <= (SIZE_MAX >> shift)) {
+			mem_max_bytes = (size_t)bytes << shift;
+		}
+		errno = saved_errno;
+	}
+	return mem_max_bytes;
+}
+
+/**
+ * mem_hugetlb_available - returns whether the hugetlb pool has a free
+ *    page, by mapping one and unmapping it again.
+ *
+ * @return non-zero if a MAP_HUGETLB page could be mapped
+ */
+static int mem_hugetlb_available(void) {
+#ifdef MAP_HUGETLB
+	void *p = mmap(NULL, HUGE_PAGE, PROT_READ|PROT_WRITE,
+				   MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		munmap(p, HUGE_PAGE);
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * mem_map_hugepages - map a 2 MB aligned heap backed by huge pages.
+ *    The heap is a PROT_NONE reservation whose pages are committed in
+ *    HUGE_PAGE units as the heap grows: MAP_HUGETLB pages taken from
+ *    the pool if it has any, otherwise pages advised with MADV_HUGEPAGE.
+ *
+ * @param r the region to map
+ * @return start of the heap, or NULL if the mapping failed
+ */
+static char *mem_map_hugepages(MemRegion *r) {
+	size_t len = HUGE_ALIGN(mem_reserve_size());
+	/* reserve an extra huge page so the heap start can be aligned */
+	void *p = mmap(NULL, len + HUGE_PAGE, PROT_NONE,
+				   MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	r->map_start = p;
+	r->map_len = len + HUGE_PAGE;
+	char *start = (char *)HUGE_ALIGN((size_t)p);
+	r->commit_brk = start;               /* nothing committed yet */
+	if (mem_hugetlb_available()) {
+		r->pages = MEM_HUGETLB_PAGES;
+		return start;
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(start, len, MADV_HUGEPAGE);
+#endif
+	r->pages = MEM_TRANSPARENT_HUGE_PAGES;
+	return start;
+}
+
+/**
+ * mem_map_pages - map a heap backed by base pages.
+ *
+ * @param r the region to map
+ * @return start of the heap, or NULL if the mapping failed
+ */
+static char *mem_map_pages(MemRegion *r) {
+	size_t len = mem_reserve_size();
+	void *p = mmap(NULL, len, PROT_READ|PROT_WRITE,
+				   MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	r->map_start = p;
+	r->map_len = len;
+	r->pages = MEM_BASE_PAGES;
+	return p;
+}
+
+/**
+ * mem_bind_range - bind a range of mapped memory to a NUMA node.
+ *
+ * @param start the start of the range
+ * @param len the bytes in the range
+ * @param node the node
+ * @return 0 if successful, -1 if the range could not be bound
+ */
+static int mem_bind_range(void *start, size_t len, int node) {
+	unsigned long mask[(MEM_MAX_NODES + 8*sizeof(unsigned long) - 1) / (8*sizeof(unsigned long))];
+	if (node < 0 || node >= MEM_MAX_NODES) {
+		return -1;
+	}
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8*sizeof(unsigned long))] = 1UL << (node % (8*sizeof(unsigned long)));
+#ifdef SYS_mbind
+	return (int)syscall(SYS_mbind, start, len, MEM_MPOL_BIND, mask, MEM_MAX_NODES + 1, 0);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * mem_bind - bind the memory of a mapped region to a NUMA node.
+ *    Pages are placed on the node when first touched, whichever
+ *    thread touches them.
+ *
+ * @param r the region
+ * @param node the node
+ */
+static void mem_bind(MemRegion *r, int node) {
+	if (mem_bind_range(r->map_start, r->map_len, node) == 0) {
+		r->node = node;
+	}
+}
+
+/**
+ * mem_commit - make the heap accessible up to new_brk, committing
+ *    whole huge pages for a huge page heap, and release the huge pages
+ *    that lie entirely above new_brk. Hugetlb pages are mapped over the
+ *    reservation and released by mapping the reservation back, which
+ *    returns them to the pool.
+ *
+ * @param new_brk the new brk pointer
+ * @return 0 if successful, -1 if the pages could not be committed
+ */
+static int mem_commit(char *new_brk) {
+	if (mem->pages == MEM_BASE_PAGES) {
+		return 0;
+	}
+	char *start = mem->start_brk;
+	char *commit = start + HUGE_ALIGN((size_t)(new_brk - start));
+	if (commit > mem->commit_brk) {
+		size_t len = commit - mem->commit_brk;
+		if (mem->pages == MEM_TRANSPARENT_HUGE_PAGES) {
+			if (mprotect(mem->commit_brk, len, PROT_READ|PROT_WRITE) != 0) {
+				return -1;
+			}
+		}
+#ifdef MAP_HUGETLB
+		else if (mmap(mem->commit_brk, len, PROT_READ|PROT_WRITE,
+					  MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_FIXED, -1, 0) == MAP_FAILED) {
+			/* the pool ran out; keep the range reserved */
+			mmap(mem->commit_brk, len, PROT_NONE,
+				 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0);
+			return -1;
+		} else if (mem->node >= 0) {
+			/* the new mapping does not inherit the binding of the reservation */
+			mem_bind_range(mem->commit_brk, len, mem->node);
+		}
+#endif
+	} else if (commit < mem->commit_brk) {
+		/* trim only whole huge pages above the brk */
+		size_t len = mem->commit_brk - commit;
+		if (mem->pages == MEM_TRANSPARENT_HUGE_PAGES) {
+			madvise(commit, len, MADV_DONTNEED);
+			mprotect(commit, len, PROT_NONE);
+		} else {
+			mmap(commit, len, PROT_NONE,
+				 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0);
+		}
+	}
+	mem->commit_brk = commit;
+	return 0;
+}
+
+/**
+ * mem_release - give the base pages that lie entirely above new_brk,
+ *    up to old_brk, back to the system. They read as zero when the heap
+ *    grows over them again: pages of a restored heap still mapped from
+ *    its file are replaced by anonymous ones, since dropping them would
+ *    only bring back the file contents.
+ *
+ * @param new_brk the new brk pointer
+ * @param old_brk the old brk pointer, above new_brk
+ */
+static void mem_release(char *new_brk, char *old_brk) {
+	if (mem->pages != MEM_BASE_PAGES || mem->shared != NULL) {
+		return;     /* huge pages are released by mem_commit */
+	}
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	char *start = (char *)(((uintptr_t)new_brk + page - 1) & ~(uintptr_t)(page - 1));
+	char *end = (char *)(((uintptr_t)old_brk + page - 1) & ~(uintptr_t)(page - 1));
+	if (start >= end) {
+		return;
+	}
+	if (mem->file_brk != NULL && start < mem->file_brk) {
+		char *file_end = (end < mem->file_brk) ? end : mem->file_brk;
+		if (mmap(start, file_end - start, PROT_READ|PROT_WRITE,
+				 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0) != MAP_FAILED) {
+			mem->file_brk = (start > (char *)mem->start_brk) ? start : NULL;
+		}
+		start = file_end;
+	}
+	if (start < end) {
+		madvise(start, end - start, MADV_DONTNEED);
+	}
+}
+
+/**
+ * mem_sync - load the brk of a mapped region, which another process
+ *    may have moved.
+ */
+static inline void mem_sync(void) {
+	if (mem->shared != NULL) {
+		mem->brk = (char *)mem->start_brk + mem->shared->brk;
+	}
+}
+
+/**
+ * mem_use_hugepages - request a heap backed by huge pages.
+ *    Takes effect on the next mem_init.
+ *
+ * @param enable non-zero to request huge pages
+ */
+void mem_use_hugepages(int enable) {
+	mem_hugepages_wanted = enable;
+}
+
+/**
+ * mem_set_max_heap - set the maximum heap size, the address space
+ *    reserved for each heap region. Takes effect on the next mem_init
+ *    and for regions created afterwards.
+ *
+ * @param bytes the maximum heap size in bytes, 0 for the default
+ */
+void mem_set_max_heap(size_t bytes) {
+	mem_max_bytes = bytes;
+}
 
-/** points to last byte of heap */
-static void *mem_brk = NULL;
+/**
+ * mem_max_heap - returns the maximum size of the current heap.
+ *
+ * @return the maximum heap size in bytes, or the size the next
+ *    mem_init will reserve if the heap is not initialized
+ */
+size_t mem_max_heap(void) {
+	if (mem->start_brk == NULL) {
+		return mem_reserve_size();
+	}
+	return (size_t)((char *)mem->max_addr - (char *)mem->start_brk);
+}
 
-/** largest legal heap address */
-static void *mem_max_addr = NULL;
+/**
+ * mem_page_backing - returns how the current heap is backed.
+ *
+ * @return the kind of pages backing the heap
+ */
+MemPages mem_page_backing(void) {
+	return mem->pages;
+}
 
 /**
  * mem_init - initialize the memory system model.
  */
 void mem_init(void) {
-	if (mem_start_brk == NULL) {
-		/* allocate the storage we will use to model the available VM */
-		mem_start_brk = (char *)malloc(MAX_HEAP);
-		if (mem_start_brk == NULL) {
-//	  		fprintf(stderr, "mem_init_vm: malloc error\n");
+	if (mem->start_brk == NULL) {
+		/* reserve the address space we will use to model the available VM;
+		   pages are only backed by memory once the heap grows over them */
+		size_t len = mem_reserve_size();
+		if (mem_hugepages_wanted) {
+			mem->start_brk = mem_map_hugepages(mem);
+		} else {
+			mem->start_brk = mem_map_pages(mem);
+		}
+		if (mem->start_brk == NULL) {
+//	  		fprintf(stderr, "mem_init_vm: mmap error\n");
 			exit(1);
 		}
 
-		mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-		mem_brk = mem_start_brk;                  /* heap is empty initially */
+		mem->max_addr = (char *)mem->start_brk + len;  /* max legal heap address */
+		mem->brk = mem->start_brk;                  /* heap is empty initially */
 	}
 }
 
@@ -50,38 +445,116 @@ void mem_init(void) {
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
-    free(mem_start_brk);
-    mem_start_brk = mem_max_addr = mem_brk = 0;
+    mem_account(mem, (char *)mem->start_brk - (char *)mem->brk);
+    if (mem->map_start != NULL) {
+    	munmap(mem->map_start, mem->map_len);
+    	mem->map_start = NULL;
+    	mem->map_len = 0;
+    }
+    mem->start_brk = mem->max_addr = mem->brk = 0;
+    mem->commit_brk = NULL;
+    mem->file_brk = NULL;
+    mem->pages = MEM_BASE_PAGES;
+}
+
+/**
+ * mem_restore - replace the heap of the current region with len bytes
+ *    of a file, mapped copy-on-write so that pages are read only when
+ *    touched and changes stay private. The heap can grow past them up
+ *    to the maximum heap size.
+ *
+ * @param fd the open file
+ * @param offset the page aligned offset of the heap in the file
+ * @param len the bytes in the heap
+ * @return 0 if successful, -1 if the file is shorter than offset + len
+ *    bytes or could not be mapped
+ */
+int mem_restore(int fd, off_t offset, size_t len) {
+	size_t max = mem_reserve_size();
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return -1;
+	}
+	/* a truncated file would fault when its missing pages are touched */
+	if (mem->shared != NULL || len > max || offset < 0 || offset > st.st_size
+			|| len > (uint64_t)(st.st_size - offset)) {
+		errno = EINVAL;
+		return -1;
+	}
+	char *p = mmap(NULL, max, PROT_READ|PROT_WRITE,
+				   MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		return -1;
+	}
+	if (len > 0 && mmap(p, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, offset) == MAP_FAILED) {
+		munmap(p, max);
+		return -1;
+	}
+	mem_deinit();                               /* release the old heap */
+	mem->map_start = p;
+	mem->map_len = max;
+	mem->start_brk = p;
+	mem->max_addr = p + max;
+	mem->brk = p + len;
+	mem_account(mem, (ptrdiff_t)len);
+	mem->file_brk = (len > 0) ? p + (len + mem_pagesize() - 1) / mem_pagesize() * mem_pagesize() : NULL;
+	return 0;
 }
 
 /**
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    Pages of a restored heap still mapped from its file are replaced
+ *    by anonymous ones, so that the heap does not see the file contents
+ *    when it grows over them again.
  */
 void mem_reset_brk() {
-    mem_brk = mem_start_brk;
+    if (mem->file_brk != NULL) {
+    	mem_release(mem->start_brk, mem->file_brk);
+    }
+    mem_account(mem, (char *)mem->start_brk - (char *)mem->brk);
+    mem->brk = mem->start_brk;
+    if (mem->shared != NULL) {
+    	mem->shared->brk = 0;
+    }
 }
 
 /**
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap and releases the pages, or
+ *    for a huge page heap the huge pages, that no longer hold any
+ *    part of it.
  *
- * @param incr amount of memory to extend heap in bytes
+ * @param incr amount of memory to extend heap in bytes, negative to shrink it
  */
-void *mem_sbrk(int incr) {
-    char *old_brk = mem_brk;
-
+void *mem_sbrk(ptrdiff_t incr) {
     // initialize memory if not already initialized
-    if (mem_start_brk == NULL) {
+    if (mem->start_brk == NULL) {
     	mem_init();
     }
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    mem_sync();
+    char *old_brk = mem->brk;
+    size_t used = (size_t)(old_brk - (char *)mem->start_brk);
+    size_t room = (size_t)((char *)mem->max_addr - old_brk);
+    /* compare sizes rather than form a pointer outside the heap */
+    if ((incr < 0) ? ((size_t)0 - (size_t)incr > used) : ((size_t)incr > room)) {
 		errno = ENOMEM;
 //		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
     }
-    mem_brk += incr;
+    if (mem_commit(mem->brk + incr) != 0) {
+		errno = ENOMEM;
+		return (void *)-1;
+    }
+    if (incr < 0) {
+    	mem_release(mem->brk + incr, mem->brk);
+    }
+    mem->brk += incr;
+    mem_account(mem, incr);
+    if (mem->shared != NULL) {
+    	mem->shared->brk = (char *)mem->brk - (char *)mem->start_brk;
+    }
     return (void *)old_brk;
 }
 
@@ -91,7 +564,7 @@ void *mem_sbrk(int incr) {
  * @return address of the first heap byte
  */
 void *mem_heap_lo() {
-    return (void *)mem_start_brk;
+    return (void *)mem->start_brk;
 }
 
 /**
@@ -101,7 +574,8 @@ void *mem_heap_lo() {
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    mem_sync();
+    return (void *)(mem->brk - 1);
 }
 
 /**
@@ -111,7 +585,28 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    mem_sync();
+    return (size_t)(mem->brk - mem->start_brk);
+}
+
+/**
+ * mem_peak_heapsize - returns the most bytes the heaps of all regions
+ *    have held together since the last mem_reset_peak, not counting
+ *    regions mapped by mem_region_map.
+ *
+ * @return the peak total heap size in bytes
+ */
+size_t mem_peak_heapsize(void) {
+	return __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * mem_reset_peak - restart the high-water mark of mem_peak_heapsize
+ *    at the current total heap size.
+ */
+void mem_reset_peak(void) {
+	__atomic_store_n(&mem_peak_bytes, __atomic_load_n(&mem_total_bytes, __ATOMIC_RELAXED),
+					 __ATOMIC_RELAXED);
 }
 
 /**
@@ -121,3 +616,219 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/**
+ * mem_region_create - create and initialize a heap region whose
+ *    memory is bound to a NUMA node.
+ *
+ * @param node the NUMA node, or -1 for no binding
+ * @return the new region, or NULL if it could not be created
+ */
+MemRegion *mem_region_create(int node) {
+	MemRegion *r = calloc(1, sizeof(MemRegion));
+	if (r == NULL) {
+		return NULL;
+	}
+	r->node = -1;
+	r->start_brk = mem_hugepages_wanted ? mem_map_hugepages(r) : mem_map_pages(r);
+	if (r->start_brk == NULL) {
+		free(r);
+		return NULL;
+	}
+	mem_bind(r, node);
+	r->max_addr = (char *)r->start_brk + mem_reserve_size();
+	r->brk = r->start_brk;
+	return r;
+}
+
+/**
+ * mem_region_map - map a region from a file, memfd or shared memory
+ *    object. An empty file is sized to size bytes and gets an empty
+ *    heap; otherwise the heap already in the file is mapped, whatever
+ *    size is given.
+ *
+ * @param fd the open file, readable and writable
+ * @param size the bytes in the mapping of an empty file
+ * @return the region, or NULL if it could not be mapped
+ */
+MemRegion *mem_region_map(int fd, size_t size) {
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return NULL;
+	}
+	int fresh = (st.st_size == 0);
+	if (fresh) {
+		size = (size + mem_pagesize() - 1) / mem_pagesize() * mem_pagesize();
+		if (size <= MEM_MAP_HEADER || ftruncate(fd, size) != 0) {
+			errno = EINVAL;
+			return NULL;
+		}
+	} else {
+		size = st.st_size;
+	}
+
+	void *p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	MemMapHeader *header = p;
+	if (fresh) {
+		memset(header, 0, sizeof(MemMapHeader));
+		memcpy(header->magic, MEM_MAP_MAGIC, sizeof(MEM_MAP_MAGIC));
+		header->map_len = size;
+	} else if (size < MEM_MAP_HEADER || memcmp(header->magic, MEM_MAP_MAGIC, sizeof(MEM_MAP_MAGIC)) != 0
+			|| header->map_len != size || header->brk > size - MEM_MAP_HEADER) {
+		munmap(p, size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	MemRegion *r = calloc(1, sizeof(MemRegion));
+	if (r == NULL) {
+		munmap(p, size);
+		return NULL;
+	}
+	r->node = -1;
+	r->pages = MEM_BASE_PAGES;
+	r->map_start = p;
+	r->map_len = size;
+	r->shared = header;
+	r->start_brk = (char *)p + MEM_MAP_HEADER;
+	r->max_addr = (char *)p + size;
+	r->brk = (char *)r->start_brk + header->brk;
+	return r;
+}
+
+/**
+ * mem_region_userdata - returns the MEM_MAP_USER bytes that a mapped
+ *    region keeps for its user in its header.
+ *
+ * @param r the region
+ * @return the user bytes, or NULL if the region is not mapped
+ */
+void *mem_region_userdata(MemRegion *r) {
+	return (r != NULL && r->shared != NULL) ? r->shared->user : NULL;
+}
+
+/**
+ * mem_region_destroy - free a region created by mem_region_create,
+ *    or unmap a region mapped by mem_region_map.
+ *
+ * @param r the region
+ */
+void mem_region_destroy(MemRegion *r) {
+	if (r == NULL || r == &mem_default) {
+		return;
+	}
+	if (mem == r) {
+		mem = &mem_default;
+	}
+	mem_account(r, (char *)r->start_brk - (char *)r->brk);
+	munmap(r->map_start, r->map_len);
+	free(r);
+}
+
+/**
+ * mem_region_select - make a region the one the mem_ heap
+ *    functions act on for the calling thread.
+ *
+ * @param r the region, or NULL for the default region
+ * @return the previously selected region
+ */
+MemRegion *mem_region_select(MemRegion *r) {
+	MemRegion *prev = mem;
+	mem = (r == NULL) ? &mem_default : r;
+	return prev;
+}
+
+/**
+ * mem_region_contains - returns whether an address lies in the
+ *    reserved address range of a region.
+ *
+ * @param r the region, or NULL for the default region
+ * @param addr the address
+ * @return non-zero if addr is inside the region
+ */
+int mem_region_contains(MemRegion *r, const void *addr) {
+	if (r == NULL) {
+		r = &mem_default;
+	}
+	return (const char *)addr >= (const char *)r->start_brk
+		&& (const char *)addr < (const char *)r->max_addr;
+}
+
+/**
+ * mem_region_node - returns the NUMA node a region is bound to.
+ *
+ * @param r the region, or NULL for the default region
+ * @return the node, or -1 if the region is not bound
+ */
+int mem_region_node(MemRegion *r) {
+	return (r == NULL) ? mem_default.node : r->node;
+}
+
+/**
+ * mem_numa_nodes - returns the number of NUMA nodes of the system:
+ *    one more than the highest node, so that node numbers can index
+ *    per-node arrays even when some nodes in between are missing.
+ *
+ * @return the number of nodes, 1 if the system is not NUMA or the
+ *    node list cannot be read
+ */
+int mem_numa_nodes(void) {
+	char list[256];
+	FILE *f = fopen("/sys/devices/system/node/possible", "r");
+	if (f == NULL) {
+		return 1;
+	}
+	char *line = fgets(list, sizeof(list), f);
+	fclose(f);
+	if (line == NULL) {
+		return 1;
+	}
+	/* a list of nodes and ranges like "0", "0-1" or "0,2-3" */
+	long last = -1;
+	char *p = list;
+	for (;;) {
+		char *end;
+		long first = strtol(p, &end, 10);
+		if (end == p || first < 0) {
+			return 1;
+		}
+		long to = first;
+		if (*end == '-') {
+			p = end + 1;
+			to = strtol(p, &end, 10);
+			if (end == p || to < first) {
+				return 1;
+			}
+		}
+		if (to > last) {
+			last = to;
+		}
+		if (*end != ',') {
+			if (*end != '\n' && *end != '\0') {
+				return 1;
+			}
+			break;
+		}
+		p = end + 1;
+	}
+	return (last >= MEM_MAX_NODES) ? MEM_MAX_NODES : (int)last + 1;
+}
+
+/**
+ * mem_numa_node - returns the NUMA node of the CPU the calling
+ *    thread is running on.
+ *
+ * @return the node, 0 if it cannot be determined
+ */
+int mem_numa_node(void) {
+	unsigned cpu = 0, node = 0;
+#ifdef SYS_getcpu
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+		return 0;
+	}
+#endif
+	return (int)node;
+}
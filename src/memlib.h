@@ -2,7 +2,61 @@
  * memlib.c - a module that simulates the memory system.  Needed because it
  *            allows us to interleave calls from the student's malloc package
  *            with the system's malloc package in libc.
+ *
+ *            The mem_ heap functions act on the heap region selected by
+ *            the calling thread with mem_region_select, initially the
+ *            default region.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** A heap region */
+typedef struct MemRegion MemRegion;
+
+/**
+ * Kinds of pages that can back the heap.
+ */
+typedef enum {
+	MEM_BASE_PAGES,              /* system page size */
+	MEM_TRANSPARENT_HUGE_PAGES,  /* 2 MB aligned, MADV_HUGEPAGE */
+	MEM_HUGETLB_PAGES            /* 2 MB aligned, MAP_HUGETLB */
+} MemPages;
+
+/**
+ * mem_use_hugepages - request a heap backed by huge pages. The heap
+ *    is aligned to 2 MB and committed and released in 2 MB units, with
+ *    MAP_HUGETLB pages from the pool when it has any, otherwise with
+ *    transparent huge pages. Takes effect on the next mem_init.
+ *
+ * @param enable non-zero to request huge pages
+ */
+void mem_use_hugepages(int enable);
+
+/**
+ * mem_set_max_heap - set the maximum heap size, the address space
+ *    reserved for each heap region, which may exceed 4 GB. Takes effect
+ *    on the next mem_init and for regions created afterwards. Without
+ *    it the MM_MAX_HEAP environment variable, in bytes with an optional
+ *    K, M or G suffix, or else MAX_HEAP gives the size.
+ *
+ * @param bytes the maximum heap size in bytes, 0 for the default
+ */
+void mem_set_max_heap(size_t bytes);
+
+/**
+ * mem_max_heap - returns the maximum size of the current heap.
+ *
+ * @return the maximum heap size in bytes
  */
+size_t mem_max_heap(void);
+
+/**
+ * mem_page_backing - returns how the current heap is backed.
+ *
+ * @return the kind of pages backing the heap
+ */
+MemPages mem_page_backing(void);
 
 /**
  * mem_init - initialize the memory system model.
@@ -21,11 +75,12 @@ void mem_reset_brk(void);
 
 /**
  * mem_sbrk - simple model of the sbrk function. Extends the heap
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap and releases the pages above it.
+ * @param incr amount of memory to extend heap in bytes, negative to shrink it
  * @return starting address of new area, or -1 if out of memory
  */
-void *mem_sbrk(int incr);
+void *mem_sbrk(ptrdiff_t incr);
 
 /**
  * mem_heap_lo - return address of the first heap byte.
@@ -48,6 +103,22 @@ void *mem_heap_hi(void);
  */
 size_t mem_heapsize(void);
 
+/**
+ * mem_peak_heapsize - returns the most bytes the heaps of all regions
+ *    have held together since the last mem_reset_peak, not counting
+ *    regions mapped by mem_region_map. It is kept by mem_sbrk, so the
+ *    peak can be read without polling the heap size.
+ *
+ * @return the peak total heap size in bytes
+ */
+size_t mem_peak_heapsize(void);
+
+/**
+ * mem_reset_peak - restart the high-water mark of mem_peak_heapsize
+ *    at the current total heap size.
+ */
+void mem_reset_peak(void);
+
 /**
  * mem_pagesize() - returns the page size of the system.
  *
@@ -55,3 +126,102 @@ size_t mem_heapsize(void);
  */
 size_t mem_pagesize(void);
 
+
+/**
+ * mem_region_create - create and initialize a heap region whose
+ *    memory is bound to a NUMA node.
+ *
+ * @param node the NUMA node, or -1 for no binding
+ * @return the new region, or NULL if it could not be created
+ */
+MemRegion *mem_region_create(int node);
+
+/**
+ * mem_restore - replace the heap of the current region with len bytes
+ *    of a file, mapped copy-on-write so that pages are read only when
+ *    touched and changes stay private. The heap can grow past them up
+ *    to the maximum heap size.
+ *
+ * @param fd the open file
+ * @param offset the page aligned offset of the heap in the file
+ * @param len the bytes in the heap
+ * @return 0 if successful, -1 if the file is shorter than offset + len
+ *    bytes or could not be mapped
+ */
+int mem_restore(int fd, off_t offset, size_t len);
+
+/**
+ * Bytes a mapped region keeps for its user in its header
+ */
+#define MEM_MAP_USER 1024
+
+/**
+ * mem_region_map - map a region from a file, memfd or shared memory
+ *    object. An empty file is sized to size bytes and gets an empty
+ *    heap; otherwise the heap already in the file is mapped, whatever
+ *    size is given.
+ *
+ * @param fd the open file, readable and writable
+ * @param size the bytes in the mapping of an empty file
+ * @return the region, or NULL if it could not be mapped
+ */
+MemRegion *mem_region_map(int fd, size_t size);
+
+/**
+ * mem_region_userdata - returns the MEM_MAP_USER bytes that a mapped
+ *    region keeps for its user in its header.
+ *
+ * @param r the region
+ * @return the user bytes, or NULL if the region is not mapped
+ */
+void *mem_region_userdata(MemRegion *r);
+
+/**
+ * mem_region_destroy - free a region created by mem_region_create,
+ *    or unmap a region mapped by mem_region_map.
+ *
+ * @param r the region
+ */
+void mem_region_destroy(MemRegion *r);
+
+/**
+ * mem_region_select - make a region the one the mem_ heap
+ *    functions act on for the calling thread.
+ *
+ * @param r the region, or NULL for the default region
+ * @return the previously selected region
+ */
+MemRegion *mem_region_select(MemRegion *r);
+
+/**
+ * mem_region_contains - returns whether an address lies in the
+ *    reserved address range of a region.
+ *
+ * @param r the region, or NULL for the default region
+ * @param addr the address
+ * @return non-zero if addr is inside the region
+ */
+int mem_region_contains(MemRegion *r, const void *addr);
+
+/**
+ * mem_region_node - returns the NUMA node a region is bound to.
+ *
+ * @param r the region, or NULL for the default region
+ * @return the node, or -1 if the region is not bound
+ */
+int mem_region_node(MemRegion *r);
+
+/**
+ * mem_numa_nodes - returns the number of NUMA nodes of the system.
+ *
+ * @return the number of nodes, 1 if the system is not NUMA
+ */
+int mem_numa_nodes(void);
+
+/**
+ * mem_numa_node - returns the NUMA node of the CPU the calling
+ *    thread is running on.
+ *
+ * @return the node, 0 if it cannot be determined
+ */
+int mem_numa_node(void);
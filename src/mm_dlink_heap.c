@@ -21,6 +21,9 @@
  *  | prev_free | next_free | size | alloc_or_not |
  *   ---------------------------------------------
  *
+ *  prev_free and next_free are 32-bit offsets in header units from the start of the heap,
+ *  so a header is 16 bytes and heaps of up to 64GB can be addressed.
+ *
  * Put the block back into the free list.
  * Two cases:
  * 1) Combine with lower adjacent block -> Check if previous block is in freelist &
@@ -54,6 +57,63 @@
  * mm_realloc() looks for the block which was dynamically allocated and reallocates it.
  *              The block should reside within the heap.
  *
+ * Placement:
+ *          The wilderness, the free block at the top of the heap, is used only when no other
+ *          free block fits within WILDERNESS_PROBES more probes, and is split at its head so
+ *          that its rest stays at the top, where the heap grows it and mm_compact trims it.
+ *          Other blocks are split at the head too unless SPLIT_HEAD is 0, and a rest smaller
+ *          than MIN_SPLIT_REMAINDER bytes is allocated with the block.
+ *
+ * Fast bins:
+ *          Small blocks (up to NFASTBINS header chunks above the minimum block size) are not
+ *          coalesced when freed. They are parked, still marked allocated, on a LIFO list per
+ *          block size and handed straight back to the next mm_malloc of the same size.
+ *          The parked blocks are merged into the free list only when a request cannot be
+ *          satisfied from the free list, or when more than FASTBIN_CONSOLIDATE_BYTES are parked.
+ *
+ * Realloc headroom:
+ *          mm_realloc grows a block in place when the block above it is free or is the end of
+ *          the heap. A block grown a second time is given REALLOC_HEADROOM_PERCENT extra room,
+ *          so a buffer that keeps growing is copied a logarithmic number of times. Shrinking
+ *          a block returns its unused tail to the free list.
+ *
+ * Shared heaps:
+ *          mm_shared_open puts a heap in a region mapped from a file, memfd or shared memory
+ *          object. As links are offsets, the heap works at any address. Its free list and fast
+ *          bin heads are kept as offsets in the region header, next to a process-shared lock,
+ *          and are loaded into a local arena while a process holds the lock.
+ *
+ * Persistence:
+ *          mm_persist writes the main heap and its free list and fast bin heads to a file.
+ *          mm_restore maps the file back copy-on-write in place of the main heap, so pages are
+ *          read only as they are touched and restart time does not depend on the allocations.
+ *
+ * Handles:
+ *          mm_halloc allocates a movable block from the main arena and returns a handle to it.
+ *          mm_hlock pins the block and gives its address until the matching mm_hunlock.
+ *          mm_compact slides unlocked movable blocks down into the free blocks below them, a
+ *          budget of bytes at a time, so free space collects at the top of the heap, and then
+ *          trims the heap. A pass resumes where the last one stopped; freeing a block moves
+ *          the resume point down to the new free block.
+ *
+ * Lifetimes:
+ *          mm_lifetime places blocks predicted to die young in a short-lived arena of their own,
+ *          so that the few long-lived blocks do not pin holes between them. Blocks are predicted
+ *          by size class, or by size class and call site, from a saturating score per class
+ *          that is learned online: a block freed within SHORT_LIFETIME bytes of allocation
+ *          raises the score of its class, a block that lives longer lowers it twice as much.
+ *          While prediction is on, next_free of an allocated block holds its allocation time
+ *          and class.
+ *
+ * Heap growth:
+ *          The heap grows by at least a growth chunk that doubles while the heap keeps growing
+ *          within GROWTH_DECAY_ALLOCS allocations, up to GROWTH_CHUNK_MAX bytes and
+ *          GROWTH_HEAP_PERCENT of the heap, and halves for every such period without growth.
+ *
+ * Statistics:
+ *          Compiled with MM_STATS, every arena counts free list probes, splits, coalesces, heap
+ *          growth and realloc copies. mm_getstats() sums them over the arenas.
+ *
  * Analysis done :
  *
  * 1. Implemented Best fit and First fit strategies
@@ -63,371 +123,2326 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "memlib.h"
 #include "mm_heap.h"
+#include "mm_profile.h"
 
 typedef union HeadFoot {
     struct {
-        union HeadFoot * previous_free;     //Pointer to the previous allocated or free block.
-        union HeadFoot * next_free;         //Pointer to the next allocated or free block.
-        size_t size_of_blk: 4 * sizeof(size_t) - 1; // Size of each block.
-        size_t alloc_or_not : 1;            //Value which indicates whether the block has been allocated or not.
+        uint32_t previous_free;             //Offset of the previous free block.
+        uint32_t next_free;                 //Offset of the next free block.
+        uint64_t size_of_blk : 61;          // Size of each block.
+        uint64_t alloc_or_not : 1;          //Value which indicates whether the block has been allocated or not.
+        uint64_t sampled : 1;               //Allocation sampled by the heap profiler.
+        uint64_t grown : 1;                 //Block was grown by realloc and gets headroom when grown again.
     } k;
 } HeadFoot;
-static const size_t blocks = 4;  // header + footer + prevptr + nextptr
-static HeadFoot * freelist = NULL;
+static const size_t blocks = 3;  // header + footer + one payload unit
 static void restart();
+static void deallocate(void *alloc);
+static void resethandles();
+static void resetlifetimes();
+
+/*
+ * Number of fast bins. Bin i holds freed blocks of exactly blocks + i header chunks.
+ */
+#ifndef NFASTBINS
+#define NFASTBINS 8
+#endif
+
+/*
+ * Parked bytes above which the fast bins are merged back into the free list.
+ */
+#ifndef FASTBIN_CONSOLIDATE_BYTES
+#define FASTBIN_CONSOLIDATE_BYTES (64*1024)
+#endif
+
+/*
+ * Extra room, in percent of the requested size, given to a block that realloc grows again.
+ */
+#ifndef REALLOC_HEADROOM_PERCENT
+#define REALLOC_HEADROOM_PERCENT 100
+#endif
+
+/*
+ * Use the wilderness, the free block at the top of the heap, only when no other free block fits.
+ */
+#ifndef WILDERNESS_LAST
+#define WILDERNESS_LAST 1
+#endif
+
+/*
+ * Free blocks probed past the wilderness for another that fits before the wilderness is used.
+ */
+#ifndef WILDERNESS_PROBES
+#define WILDERNESS_PROBES 64
+#endif
+
+/*
+ * Allocate from the head of a split free block rather than its tail, so allocations
+ * fill holes from the bottom up. The wilderness is always split at its head.
+ */
+#ifndef SPLIT_HEAD
+#define SPLIT_HEAD 1
+#endif
+
+/*
+ * Smallest free block, in bytes including its header and footer, split off an allocation;
+ * a smaller rest is allocated with the block. At least the minimum block size.
+ */
+#ifndef MIN_SPLIT_REMAINDER
+#define MIN_SPLIT_REMAINDER 48
+#endif
+
+/*
+ * Most bytes the heap grows by beyond a request, and the largest share of the heap
+ * in percent that this may be.
+ */
+#ifndef GROWTH_CHUNK_MAX
+#define GROWTH_CHUNK_MAX (1024*1024)
+#endif
+#ifndef GROWTH_HEAP_PERCENT
+#define GROWTH_HEAP_PERCENT 3
+#endif
+
+/*
+ * Allocations within which the heap growing again doubles the growth chunk. The chunk
+ * halves for each such period in which the heap did not grow.
+ */
+#ifndef GROWTH_DECAY_ALLOCS
+#define GROWTH_DECAY_ALLOCS 1024
+#endif
+
+/*
+ * Free bytes at the top of the heap above which mm_compact trims the heap.
+ */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (64*1024)
+#endif
+
+/*
+ * Bytes allocated after a block within which a free counts as a short lifetime.
+ */
+#ifndef SHORT_LIFETIME
+#define SHORT_LIFETIME (64*1024)
+#endif
+
+/* Lifetime clock ticks, in bytes allocated; stamps wrap after 2^24 ticks. */
+#define LIFETIME_UNIT 64
+#define LIFETIME_STAMP_MASK 0xFFFFFFu
+
+/* Prediction classes, class 0 meaning no prediction, and the bound of their scores. */
+#define LIFETIME_CLASSES 256
+#define LIFETIME_MAX_SCORE 15
+
+/*
+ * Statistics are counted only when compiled with MM_STATS.
+ */
+#ifdef MM_STATS
+#define STAT(stmt) stmt
+#else
+#define STAT(stmt)
+#endif
+
+/*
+ * Largest number of NUMA node arenas.
+ */
+#ifndef MAX_ARENAS
+#define MAX_ARENAS 64
+#endif
+
+/*
+ * Largest number of thread arenas.
+ */
+#ifndef MAX_THREAD_ARENAS
+#define MAX_THREAD_ARENAS 256
+#endif
+
+/*
+ * An arena is an independent heap: a memlib region with its own free list and fast bins.
+ * The main arena uses the default region. After mm_numa_init every NUMA node has an arena
+ * whose region is bound to the node, and mm_thread_arena gives a thread a private arena.
+ * Threads allocate from their own arena. A block freed by a thread that does not allocate
+ * from the owning arena is pushed with a single CAS onto the owner's remote free list,
+ * which the owner drains in bulk on its next malloc.
+ */
+typedef struct Arena {
+    HeadFoot *base;                     //Start of the heap, which free list offsets are relative to.
+    HeadFoot *freelist;                 //Free list of the arena.
+    HeadFoot *fastbins[NFASTBINS];      //LIFO list of parked blocks per size.
+    size_t fastbin_bytes;               //Total bytes parked in the fast bins.
+    MemRegion *region;                  //Region holding the heap, NULL for the default region.
+    pthread_mutex_t lock;               //Serializes the threads using the arena.
+    _Atomic(HeadFoot *) remote_frees;   //Blocks freed by other threads, linked through their payload.
+    bool owned;                         //Thread arena in use by a live thread.
+    MMStats stats;                      //Statistics of the arena, counted with MM_STATS.
+    struct SharedState *shared;         //State of a shared heap, null for a private arena.
+    uint32_t compact_from;              //Offset of the block where the next compaction pass resumes.
+    size_t growth_chunk;                //Bytes the heap last grew by at least, 0 before it grew.
+    size_t allocs;                      //Allocations served since the heap was restarted.
+    size_t allocs_at_growth;            //Allocations served when the heap last grew.
+} Arena;
+
+/* Marks an initialized shared heap. */
+#define SHARED_MAGIC "MMHEAP1"
+
+/*
+ * State of a shared heap, kept in the header of its mapped region
+ * so that every process mapping the region sees it.
+ */
+typedef struct SharedState {
+    char magic[8];                      //SHARED_MAGIC once the heap is initialized.
+    pthread_mutex_t lock;               //Process-shared lock of the heap.
+    uint32_t freelist;                  //Offset of the free list.
+    uint32_t fastbins[NFASTBINS];       //Offsets of the parked block lists, 0 if empty.
+    uint64_t fastbin_bytes;             //Total bytes parked in the fast bins.
+    uint64_t root;                      //Byte offset of the root block, 0 if none.
+} SharedState;
+
+_Static_assert(sizeof(SharedState) <= MEM_MAP_USER, "shared heap state must fit the region header");
+
+/* Marks a persisted heap file. */
+#define PERSIST_MAGIC "MMPERS1"
+
+/* Bytes before the heap in a persisted heap file, a page so the heap can be mapped. */
+#define PERSIST_HEADER 4096
+
+/*
+ * Header of a persisted heap file. The heap follows at PERSIST_HEADER.
+ */
+typedef struct PersistHeader {
+    char magic[8];                      //PERSIST_MAGIC.
+    uint32_t unit;                      //Size of a header unit, to reject files of other builds.
+    uint32_t nfastbins;                 //Number of fast bins, likewise.
+    uint64_t heapsize;                  //Bytes in the heap.
+    uint32_t freelist;                  //Offset of the free list.
+    uint32_t fastbins[NFASTBINS];       //Offsets of the parked block lists, 0 if empty.
+    uint64_t fastbin_bytes;             //Total bytes parked in the fast bins.
+    uint64_t root;                      //Byte offset of the root block, 0 if none.
+} PersistHeader;
+
+_Static_assert(sizeof(PersistHeader) <= PERSIST_HEADER, "persisted heap header must fit its page");
+
+/* A heap in a mapped region. */
+struct MMSharedHeap {
+    Arena arena;                        //Local view of the shared heap.
+};
+
+static Arena main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static Arena node_arenas[MAX_ARENAS];           //One arena per NUMA node.
+static int num_node_arenas = 0;                 //Zero unless NUMA arenas are enabled.
+static Arena thread_arenas[MAX_THREAD_ARENAS];  //Private arenas of threads.
+static Arena short_arena;                       //Arena of blocks predicted to die young.
+static atomic_int num_thread_arenas = 0;        //Thread arenas created so far.
+static pthread_mutex_t thread_arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_arena_key;          //Releases a thread arena when its thread exits.
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+static __thread Arena *arena = &main_arena;     //Arena the heap functions act on.
+static __thread Arena *thread_arena = NULL;     //Arena the thread allocates from.
+
+static atomic_size_t realloc_copied = 0;         //Bytes copied by realloc since the last reset.
+
+static MMLifetimeMode lifetime_mode = MM_LIFETIME_OFF;             //How blocks are placed by lifetime.
+static atomic_size_t lifetime_clock = 0;                            //Bytes allocated while predicting.
+static _Atomic signed char lifetime_score[LIFETIME_CLASSES];        //Short-lived if above 0.
+
+/*
+ * An entry of the handle table. An unused entry has no block and
+ * links the next unused entry through locks.
+ */
+typedef struct {
+    uint32_t block;                     //Offset of the movable block in the main arena, 0 if unused.
+    uint32_t locks;                     //mm_hlock calls not yet matched by mm_hunlock.
+} HandleEntry;
+
+static HandleEntry *handles = NULL;             //Handle table, entry 0 unused so 0 is no handle.
+static uint32_t handle_count = 0;               //Entries in the table.
+static uint32_t handle_capacity = 0;            //Entries allocated.
+static uint32_t free_handles = 0;               //First unused entry, 0 if none.
+
+/* Stored in previous_free of a parked block to tell it apart from an allocated one. */
+#define FASTBIN_MARK UINT32_MAX
+
+/* Stored in previous_free of a movable block, whose next_free holds its handle. */
+#define HANDLE_MARK (UINT32_MAX - 1)
+
+/* Stored in previous_free of a block on a remote free list, so that it is not freed again before its owner frees it. */
+#define REMOTE_MARK (UINT32_MAX - 2)
+
+/* Largest heap in header units, keeping every offset below the marks. */
+#define MAX_HEAP_UNITS ((size_t)UINT32_MAX - 2)
 
 /**
- * Initialize the dynamic memory.
+ * Get the block at an offset in the heap of the current arena.
+ * @param off The offset in header units.
+ * @return Returns the block.
  */
 
-void mm_init() {
-    if (freelist == NULL) {
-        mem_init();
-        restart();
-    }
+static inline HeadFoot *blockat(uint32_t off) {
+    return arena->base + off;
 }
 
+
 /**
- * Reset the dynamic memory.
+ * Get the offset of a block in the heap of the current arena.
+ * @param blck The block.
+ * @return Returns the offset in header units.
  */
 
-void mm_reset() {
-    if (freelist == NULL) {
-        mm_init();
-    } else {
-        mem_reset_brk();
-        restart();
-    }
+static inline uint32_t offsetof_block(HeadFoot *blck) {
+    return (uint32_t)(blck - arena->base);
 }
 
+
 /**
- * De-initialize the dynamic memory.
+ * Get the next block on the free list.
+ * @param blck The free block.
+ * @return Returns the next free block.
  */
 
-void mm_deinit() {
-    mem_deinit();
-    freelist = NULL;
+static inline HeadFoot *nextfree(HeadFoot *blck) {
+    return blockat(blck->k.next_free);
 }
 
+
 /**
- * Reinitialize the free list.
- * Restart the heap structure with all the initial values set.
+ * Get the previous block on the free list.
+ * @param blck The free block.
+ * @return Returns the previous free block.
  */
 
-static void restart() {
-    
-    if (mem_sbrk((blocks + 1) * sizeof(HeadFoot)) == NULL) {
-        return;
-    }
-    freelist = mem_heap_lo();
-    freelist[blocks-1].k.size_of_blk = blocks;      //Fixing the size of blocks.
-    freelist->k.size_of_blk = blocks;
-    size_t num = 1;
-    freelist[blocks-1].k.alloc_or_not = num;        //Marking blocks as allocated.
-    freelist->k.alloc_or_not = num;
-    freelist->k.next_free = freelist;
-    freelist->k.previous_free = freelist;
-    HeadFoot *lastblck = freelist + blocks;
-    lastblck->k.alloc_or_not = 1;                 //Marking last block as allocated.
-    lastblck->k.size_of_blk = 1;
+static inline HeadFoot *prevfree(HeadFoot *blck) {
+    return blockat(blck->k.previous_free);
 }
 
 
 /**
- * Take free block from the freelist.
- * @param head The pointer which corresponds to the block.
+ * Get the next block on a fast bin list. The initial block is never parked,
+ * so offset zero ends the list.
+ * @param blck The parked block.
+ * @return Returns the next parked block or null.
  */
 
-static void takefromlist(HeadFoot *head) {
-    
-    HeadFoot *after = head->k.next_free;         //Fixing the pointer after the block which is to be removed.
-    HeadFoot *before = head->k.previous_free;        //Fixing the pointer before the block which is to be removed.
-    before->k.next_free = after;                 //Pointing the previous block after the removed block.
-    after->k.previous_free = before;                 //Pointing the next block to the block before the removed block.
+static inline HeadFoot *nextparked(HeadFoot *blck) {
+    return (blck->k.next_free == 0) ? NULL : blockat(blck->k.next_free);
 }
 
-
 /**
- * Convert the specified header sized chunks to bytes.
- * @param headchunk The size to be converted in header chunks.
- * @return Returns the equivalent size in bytes.
+ * Load the state of a shared heap into its arena.
+ * @param a The arena of the shared heap, with its region selected.
  */
 
-static size_t conv_bytes(size_t headchunk) {
-    size_t bc = headchunk * sizeof(HeadFoot);
-    return bc;
+static void loadshared(Arena *a) {
+    SharedState *st = a->shared;
+    a->base = mem_heap_lo();
+    a->freelist = a->base + st->freelist;
+    for (int bin = 0; bin < NFASTBINS; bin++) {
+        a->fastbins[bin] = (st->fastbins[bin] == 0) ? NULL : a->base + st->fastbins[bin];
+    }
+    a->fastbin_bytes = st->fastbin_bytes;
 }
 
 
 /**
- * Put the block back into the free list.
- * Two cases:
- * 1)Combine with lower adjacent block->Check if previous block is in freelist &
- * Make the block into one bigger block.
- * 2)Combine with upper adjacent block->Check if next part of memory is in freelist &
- * Make the block into one bigger block.
- * @param blockval The blocks which are allocated and needs to be freed.
+ * Store the state of a shared heap from its arena.
+ * @param a The arena of the shared heap.
  */
 
-static void returnfreeblocktolist(HeadFoot *blockval) {
-    
-    size_t headch = blockval->k.size_of_blk;
-    blockval[headch-1].k.alloc_or_not = 0;          //Marking  blocks as free
-    blockval->k.alloc_or_not = 0;                 //Marking the first block as free
-    if (blockval[-1].k.alloc_or_not == 0) {             //Check if the block is not allocated
-        blockval = blockval - blockval[-1].k.size_of_blk;
-        headch = headch + blockval->k.size_of_blk;
-        blockval[headch-1].k.size_of_blk = headch;
-        blockval->k.size_of_blk = headch;
-    } else  {
-        HeadFoot *after = freelist->k.next_free;
-        blockval->k.previous_free = freelist;
-        blockval->k.next_free = after;          //Place the block after the specified block.
-        after->k.previous_free = blockval;
-        freelist->k.next_free = blockval;
-    }
-    freelist = blockval;
-    if (blockval[headch].k.alloc_or_not == 0) {
-        takefromlist(blockval+headch);          //Place the block with the upper blocks.
-        headch = headch + blockval[headch].k.size_of_blk;
-        blockval[headch-1].k.size_of_blk = headch;
-        blockval->k.size_of_blk = headch;
+static void storeshared(Arena *a) {
+    SharedState *st = a->shared;
+    st->freelist = (uint32_t)(a->freelist - a->base);
+    for (int bin = 0; bin < NFASTBINS; bin++) {
+        st->fastbins[bin] = (a->fastbins[bin] == NULL) ? 0 : (uint32_t)(a->fastbins[bin] - a->base);
     }
+    st->fastbin_bytes = a->fastbin_bytes;
 }
 
 
 /**
- * Convert the specified bytes to header sized chunks.
- * @param bytechunks The size to be converted in bytes.
- * @return Returns header sized chunks.
+ * Lock an arena. The lock of a shared heap is recovered if its holder died.
+ * @param a The arena.
  */
 
-static size_t headchunksize(size_t bytechunks) {
-    size_t hc = (bytechunks + sizeof(HeadFoot) - 1);
-    hc = hc / sizeof(HeadFoot);
-    return hc;
+static void lockarena(Arena *a) {
+    if (a->shared == NULL) {
+        pthread_mutex_lock(&a->lock);
+    } else if (pthread_mutex_lock(&a->shared->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&a->shared->lock);
+    }
 }
 
+
 /**
- * Increase heap size to include more free blocks.
- * @param heads The number of excess header sized units to be added.
- * @return Returns the extended storage pointer.
+ * Make an arena the one the heap functions act on, locking it and
+ * selecting its region.
+ * @param a The arena to enter.
+ * @return Returns the arena that was entered before.
  */
 
-static HeadFoot *increaseheapsize(size_t heads) {
-    
-    size_t allocations = headchunksize((size_t) sysconf(_SC_PAGESIZE));
-    if (heads < allocations) {
-        heads = allocations;
+static Arena *arena_enter(Arena *a) {
+    lockarena(a);
+    Arena *prev = arena;
+    arena = a;
+    mem_region_select(a->region);
+    if (a->shared != NULL) {
+        loadshared(a);
     }
-    size_t bytecounts = conv_bytes(heads);
-    void *incr = (void *) mem_sbrk(bytecounts);
-    if (incr == (void *) -1) {          //cannot increase space
-        return NULL;
-    }
-    HeadFoot *blck = (HeadFoot*) incr - 1;
-    blck[heads-1].k.size_of_blk = heads;
-    blck->k.size_of_blk = heads;        //adjust the size of the block to the new size.
-    blck[heads-1].k.alloc_or_not = 0;   //Mark blocks free.
-    blck->k.alloc_or_not = 0;
-    blck[heads].k.alloc_or_not = 1;     //Mark last block as allocated.
-    blck[heads].k.size_of_blk = 1;      //Size of the last block
-    returnfreeblocktolist(blck);        //put the included storage to the list of free blocks.
-    return freelist;                    //return the new free list.
+    return prev;
 }
 
 
 /**
- * Find a free block from the free list using the first fit algorithm.
- * @param headc The number of header chunks required.
- * @return a pointer which points to the start of the free blocks.
+ * Leave the current arena, unlocking it and re-entering the previous one.
+ * @param prev The arena returned by arena_enter.
  */
-static HeadFoot *pick_free_block_from_list_first_fit(size_t headc) {
-    HeadFoot *blck = freelist;
-    while (true) {
-        if (( headc <= blck->k.size_of_blk) && (blck->k.alloc_or_not == 0)) {
-            if (headc + blocks > blck->k.size_of_blk) {
-                if ( blck == freelist) {
-                    freelist = blck->k.previous_free;
-                    
-                }
-                takefromlist(blck);         //Get the first fit block from the free list
-                size_t alc = blck->k.size_of_blk;
-                size_t  val = 1;
-                blck[alc-1].k.alloc_or_not = val;       //Mark block as allocated.
-                blck->k.alloc_or_not = val;
-            }
-            else {                               //Fragmentation.
-                // We divide the blocks into two blocks.
-                // First block stays in the free list.
-                // Second block is allocated to the user.
-                size_t alc = blck->k.size_of_blk - headc;
-                blck->k.size_of_blk = blck->k.size_of_blk - headc;
-                blck[alc-1].k.size_of_blk = blck->k.size_of_blk;
-                blck[alc+headc-1].k.size_of_blk = headc;
-                blck[alc].k.size_of_blk = headc;
-                size_t  val = 1;
-                blck[alc+headc-1].k.alloc_or_not = val;
-                blck[alc].k.alloc_or_not = val;
-                blck = blck + alc;
-            }
-            return blck;
-        }
-        blck = blck->k.next_free;
-        if (blck == freelist) {
-            blck = increaseheapsize(headc);   //Increase storage since we cannot find a block which is big enough.
-            if (blck == NULL) {
-                return NULL;
-            }
-        }
+
+static void arena_leave(Arena *prev) {
+    Arena *a = arena;
+    if (a->shared != NULL) {
+        storeshared(a);
     }
+    arena = prev;
+    mem_region_select(prev->region);
+    pthread_mutex_unlock((a->shared != NULL) ? &a->shared->lock : &a->lock);
 }
 
+
 /**
- * Find a free block from the free list using the best fit algorithm.
- * @param headc The number of header chunks required.
- * @return a pointer which points to the start of the free blocks.
+ * Check whether any node, thread or short-lived arenas exist.
+ * @return Returns true if allocations go through arenas.
  */
-static HeadFoot *pick_free_block_from_list_best_fit(size_t headc) {
-    int count = 0;
-    HeadFoot *temp = freelist;
-    HeadFoot *best_fit = freelist;
-    HeadFoot *val = freelist;
-    //Finds the best fit block by traversing through the free list.
-    while(true) {
-        if (freelist != NULL) {
-            do {
-                if ((headc <= temp->k.size_of_blk)
-                    && (temp->k.alloc_or_not == 0)
-                    && (temp->k.size_of_blk < best_fit->k.size_of_blk)) {
-                    best_fit = temp;
-                }
-                temp = temp->k.next_free;
-                count++;
-            } while (temp != freelist);
-        }
-        if (best_fit == val) {
-            if (temp == NULL) {
-                return NULL;
-            }
-            break;
+
+static bool arenas_enabled() {
+    return num_node_arenas > 0 || atomic_load_explicit(&num_thread_arenas, memory_order_relaxed) > 0
+        || short_arena.region != NULL;
+}
+
+
+/**
+ * Find the arena the calling thread allocates from.
+ * @return Returns the thread's own arena, else the arena of its NUMA node, else the main arena.
+ */
+
+static Arena *local_arena() {
+    if (thread_arena == NULL) {
+        if (num_node_arenas > 0) {
+            thread_arena = &node_arenas[mem_numa_node() % num_node_arenas];
         } else {
-            break;
-        }
-    }
-    HeadFoot *blck = best_fit;
-    while (true) {
-        if (( headc <= blck->k.size_of_blk) && (blck->k.alloc_or_not == 0)) {
-            if (headc + blocks > blck->k.size_of_blk) {
-                if ( blck == freelist) {
-                    freelist = blck->k.previous_free;
-                    
-                }
-                takefromlist(blck);
-                size_t alc = blck->k.size_of_blk;
-                size_t  val1 = 1;
-                blck[alc-1].k.alloc_or_not = val1;       //Mark block as allocated.
-                blck->k.alloc_or_not = val1;
-            }
-            else {                               //Fragmentation.
-                // We divide the blocks into two blocks.
-                // First block stays in the free list.
-                // Second block is allocated to the user.
-                size_t alc = blck->k.size_of_blk - headc;
-                blck->k.size_of_blk = blck->k.size_of_blk - headc;
-                blck[alc-1].k.size_of_blk = blck->k.size_of_blk;
-                blck[alc+headc-1].k.size_of_blk = headc;
-                blck[alc].k.size_of_blk = headc;
-                size_t  val1 = 1;
-                blck[alc+headc-1].k.alloc_or_not = val1;
-                blck[alc].k.alloc_or_not = val1;
-                blck = blck + alc;
-            }
-            return blck;
-        }
-        blck = blck->k.next_free;
-        if (blck == freelist) {
-            blck = increaseheapsize(headc);   //Increase storage since we cannot find a block which is big enough.
-            if (blck == NULL) {
-                return NULL;
-            }
+            thread_arena = &main_arena;
         }
     }
+    return thread_arena;
 }
 
+
 /**
- * Allocates the specified size and returns a pointer to the allocated storage
- * if storage cannot be allocated sets errno and returns null.
- * @param bytechunks The total amount of bytes which we need to allocate to our storage.
- * @return Returns a pointer to the allocated memory if storage was available or returns null if allocation was not possible.
+ * Find the arena whose region holds an allocated block.
+ * @param allocated The allocated block pointer.
+ * @return Returns the owning arena or null if no arena holds the pointer.
  */
 
-void *mm_malloc(size_t bytechunks) {
-    if (freelist == NULL) {         //Initialize if not already initialized.
-        mm_init();
+static Arena *owning_arena(void *allocated) {
+    for (int i = 0; i < num_node_arenas; i++) {
+        if (mem_region_contains(node_arenas[i].region, allocated)) {
+            return &node_arenas[i];
+        }
     }
-    size_t chunks = headchunksize(bytechunks);
-    chunks = chunks + 2;   //Header & Footer is always added.
-    if (blocks > chunks) {
-        chunks = blocks;
+    int n = atomic_load_explicit(&num_thread_arenas, memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        if (mem_region_contains(thread_arenas[i].region, allocated)) {
+            return &thread_arenas[i];
+        }
     }
-    HeadFoot *headptr = pick_free_block_from_list_first_fit(chunks);  //Get a block based on first fit algorithm.
-   //  HeadFoot *headptr = pick_free_block_from_list_best_fit(chunks); //Get a block based on best fit algorithm.
-    if (headptr == NULL) {
-        errno = ENOMEM;
-        return NULL;
+    if (mem_region_contains(NULL, allocated)) {
+        return &main_arena;
     }
-    return headptr + 1;         //pointer to the allocated memory.
+    if (short_arena.region != NULL && mem_region_contains(short_arena.region, allocated)) {
+        return &short_arena;
+    }
+    return NULL;
 }
 
 
 /**
- * Find the required block if it was allocated.
- * @param allocated The allocated block pointer.
- * @return if pointer does not reside within allocated block returns null or returns the pointer to allocated block.
+ * Create an arena in a new region bound to a NUMA node.
+ * @param a The arena to set up.
+ * @param node The NUMA node.
+ * @return Returns true if the region could be created.
  */
 
-static HeadFoot *allocatedblock(void *allocated) {
-    if (allocated <= mem_heap_lo() || allocated >= mem_heap_hi() || allocated == NULL) {        //If the pointer is not within bounds or invalid.
-        return NULL;
+static bool create_arena(Arena *a, int node) {
+    a->region = mem_region_create(node);
+    if (a->region == NULL) {
+        return false;
     }
-    HeadFoot *blck_list;
-    if((uintptr_t)allocated & (sizeof(max_align_t)-1) == 0)  {
-        blck_list = (HeadFoot*)allocated-1;
-        if (blck_list->k.alloc_or_not == 1) {     //Check if the block is allocated.
-            size_t headvals = blck_list->k.size_of_blk;
-            if (blocks <= headvals) {
-                if (   (blck_list->k.size_of_blk == blck_list[headvals-1].k.size_of_blk)
-                    || (blck_list->k.alloc_or_not == blck_list[headvals-1].k.alloc_or_not)) {
-                    return blck_list;
-                }
-            }
+    pthread_mutex_init(&a->lock, NULL);
+    Arena *prev = arena_enter(a);
+    restart();
+    arena_leave(prev);
+    return true;
+}
+
+
+/**
+ * Free the region of an arena and clear the arena.
+ * @param a The arena.
+ */
+
+static void destroy_arena(Arena *a) {
+    mem_region_destroy(a->region);
+    pthread_mutex_destroy(&a->lock);
+    memset(a, 0, sizeof(Arena));
+}
+
+
+/**
+ * Push a block freed by a foreign thread onto the remote free list of its arena.
+ * The block is checked without the lock of its arena, and marked so that freeing
+ * it again before its owner drains the list fails instead of linking it twice.
+ * A remote free therefore costs two compare-and-swaps, one on the block header
+ * for the mark and one on the list head, against none for a local free.
+ * @param owner The arena owning the block.
+ * @param blck The block header of the storage being freed.
+ * @return Returns false if the storage is not an allocated block of the arena.
+ */
+
+static bool push_remote_free(Arena *owner, HeadFoot *blck) {
+    if (owner->base == NULL || blck <= owner->base
+        || ((char *)blck - (char *)owner->base) % sizeof(HeadFoot) != 0) {
+        return false;
+    }
+    size_t size = blck->k.size_of_blk;
+    if (blck->k.alloc_or_not != 1 || size < blocks || size > MAX_HEAP_UNITS
+        || !mem_region_contains(owner->region, blck + size - 1) || blck[size-1].k.size_of_blk != size) {
+        return false;
+    }
+    uint32_t unmarked = 0;          //Not parked, movable or already on a remote free list.
+    if (!__atomic_compare_exchange_n(&blck->k.previous_free, &unmarked, REMOTE_MARK, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    HeadFoot *head = atomic_load_explicit(&owner->remote_frees, memory_order_relaxed);
+    do {
+        *(HeadFoot **)(blck + 1) = head;        //Offsets are only meaningful to the owner.
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote_frees, &head, blck,
+                                                    memory_order_release, memory_order_relaxed));
+    return true;
+}
+
+
+/**
+ * Take the whole remote free list of the current arena and free its blocks.
+ * Called whenever the owner holds the arena lock to allocate, free, reset
+ * or read the heap, so freed blocks are not left out of the free space.
+ */
+
+static void drain_remote_frees() {
+    if (atomic_load_explicit(&arena->remote_frees, memory_order_relaxed) == NULL) {
+        return;                                 //Nothing pushed, skip the exchange.
+    }
+    HeadFoot *blck = atomic_exchange_explicit(&arena->remote_frees, NULL, memory_order_acquire);
+    while (blck != NULL) {
+        HeadFoot *next = *(HeadFoot **)(blck + 1);
+        blck->k.previous_free = 0;              //Clear the remote mark so the block can be freed.
+        deallocate(blck + 1);
+        blck = next;
+    }
+}
+
+
+/**
+ * Reset the heap of an arena to empty.
+ * @param a The arena.
+ */
+
+static void reset_arena(Arena *a) {
+    Arena *prev = arena_enter(a);
+    drain_remote_frees();
+    mem_reset_brk();
+    restart();
+    arena_leave(prev);
+}
+
+
+/**
+ * Mark the arena of an exiting thread as free to be adopted by a new thread,
+ * after freeing the blocks other threads pushed onto its remote free list.
+ * @param a The thread arena.
+ */
+
+static void release_thread_arena(void *a) {
+    Arena *prev = arena_enter(a);
+    drain_remote_frees();
+    arena_leave(prev);
+    pthread_mutex_lock(&thread_arenas_lock);
+    ((Arena *)a)->owned = false;
+    pthread_mutex_unlock(&thread_arenas_lock);
+}
+
+
+/**
+ * Create the key that releases thread arenas.
+ */
+
+static void create_thread_arena_key() {
+    pthread_key_create(&thread_arena_key, release_thread_arena);
+}
+
+/**
+ * Initialize the dynamic memory.
+ */
+
+void mm_init() {
+    if (arena->freelist == NULL) {
+        mem_init();
+        restart();
+    }
+}
+
+/**
+ * Reset the dynamic memory.
+ */
+
+void mm_reset() {
+    if (arena->freelist == NULL) {
+        mm_init();
+    } else {
+        mem_reset_brk();
+        restart();
+    }
+    for (int i = 0; i < num_node_arenas; i++) {
+        reset_arena(&node_arenas[i]);
+    }
+    int n = atomic_load(&num_thread_arenas);
+    for (int i = 0; i < n; i++) {
+        reset_arena(&thread_arenas[i]);
+    }
+    if (short_arena.region != NULL) {
+        reset_arena(&short_arena);
+    }
+    resetlifetimes();
+    atomic_store(&realloc_copied, 0);
+    resethandles();
+    mm_profile_reset();
+}
+
+/**
+ * De-initialize the dynamic memory.
+ */
+
+void mm_deinit() {
+    for (int i = 0; i < num_node_arenas; i++) {
+        destroy_arena(&node_arenas[i]);
+    }
+    num_node_arenas = 0;
+    int n = atomic_load(&num_thread_arenas);
+    for (int i = 0; i < n; i++) {
+        destroy_arena(&thread_arenas[i]);
+    }
+    atomic_store(&num_thread_arenas, 0);
+    thread_arena = NULL;
+    if (short_arena.region != NULL) {
+        destroy_arena(&short_arena);
+    }
+    lifetime_mode = MM_LIFETIME_OFF;
+    resetlifetimes();
+    mem_deinit();
+    arena->freelist = NULL;
+    resethandles();
+}
+
+
+/**
+ * Get the number of bytes realloc has copied to move blocks.
+ * @return Returns the bytes copied since the heap was last reset.
+ */
+
+size_t mm_realloc_copied() {
+    return atomic_load_explicit(&realloc_copied, memory_order_relaxed);
+}
+
+
+#ifdef MM_STATS
+/**
+ * Add the statistics of an arena to a total.
+ * @param total The total.
+ * @param a The arena.
+ */
+
+static void addstats(MMStats *total, Arena *a) {
+    Arena *prev = arena_enter(a);
+    drain_remote_frees();
+    MMStats *st = &a->stats;
+    total->searches += st->searches;
+    total->probes += st->probes;
+    if (st->max_probes > total->max_probes) {
+        total->max_probes = st->max_probes;
+    }
+    for (int i = 0; i < MM_PROBE_BUCKETS; i++) {
+        total->probe_hist[i] += st->probe_hist[i];
+    }
+    total->fastbin_hits += st->fastbin_hits;
+    total->splits += st->splits;
+    total->coalesce_lower += st->coalesce_lower;
+    total->coalesce_upper += st->coalesce_upper;
+    total->coalesce_both += st->coalesce_both;
+    total->growth_calls += st->growth_calls;
+    total->growth_bytes += st->growth_bytes;
+    if (st->growth_max > total->growth_max) {
+        total->growth_max = st->growth_max;
+    }
+    total->realloc_copies += st->realloc_copies;
+    total->realloc_copy_bytes += st->realloc_copy_bytes;
+    total->compact_moves += st->compact_moves;
+    total->compact_bytes += st->compact_bytes;
+    total->trim_calls += st->trim_calls;
+    total->trim_bytes += st->trim_bytes;
+    total->short_allocs += st->short_allocs;
+    total->short_survivors += st->short_survivors;
+    total->missed_short += st->missed_short;
+    arena_leave(prev);
+}
+#endif
+
+
+/**
+ * Get the heap statistics since the heap was last reset, summed over the arenas.
+ * @param stats Set to the statistics, or zeroed if they are not kept.
+ * @return Returns 1 if the heap was compiled with MM_STATS, otherwise 0.
+ */
+
+int mm_getstats(MMStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+#ifdef MM_STATS
+    addstats(stats, &main_arena);
+    for (int i = 0; i < num_node_arenas; i++) {
+        addstats(stats, &node_arenas[i]);
+    }
+    int n = atomic_load(&num_thread_arenas);
+    for (int i = 0; i < n; i++) {
+        addstats(stats, &thread_arenas[i]);
+    }
+    if (short_arena.region != NULL) {
+        addstats(stats, &short_arena);
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * Give every NUMA node its own arena in a region bound to that node.
+ * From then on threads allocate from the arena of the node they run on
+ * and blocks are freed to the arena that owns them.
+ * @return Returns the number of node arenas, or zero if they could not be created.
+ */
+
+int mm_numa_init() {
+    if (num_node_arenas > 0) {
+        return num_node_arenas;
+    }
+    mm_init();
+    int nodes = mem_numa_nodes();
+    if (nodes > MAX_ARENAS) {
+        nodes = MAX_ARENAS;
+    }
+    for (int node = 0; node < nodes; node++) {
+        if (!create_arena(&node_arenas[node], node)) {
+            while (node-- > 0) {            //Undo the arenas created so far.
+                destroy_arena(&node_arenas[node]);
+            }
+            return 0;
+        }
+    }
+    num_node_arenas = nodes;
+    if (thread_arena == &main_arena) {
+        thread_arena = NULL;                //Pick up the arena of the thread's node.
+    }
+    return nodes;
+}
+
+
+/**
+ * Give the calling thread a private arena in a region bound to its NUMA node.
+ * Other threads freeing its blocks push them onto the arena's remote free list.
+ * The arena of an exited thread is adopted by the next thread asking for one.
+ * @return Returns the index of the thread arena, or -1 if no arena is available.
+ */
+
+int mm_thread_arena() {
+    mm_init();
+    pthread_once(&thread_arena_once, create_thread_arena_key);
+    int n = atomic_load(&num_thread_arenas);
+    if (thread_arena >= thread_arenas && thread_arena < thread_arenas + n) {
+        return thread_arena - thread_arenas;        //Already has one.
+    }
+    pthread_mutex_lock(&thread_arenas_lock);
+    Arena *a = NULL;
+    for (int i = 0; i < n && a == NULL; i++) {
+        if (!thread_arenas[i].owned) {
+            a = &thread_arenas[i];
+        }
+    }
+    if (a == NULL && n < MAX_THREAD_ARENAS && create_arena(&thread_arenas[n], mem_numa_node())) {
+        a = &thread_arenas[n];
+        atomic_store_explicit(&num_thread_arenas, n + 1, memory_order_release);
+    }
+    if (a != NULL) {
+        a->owned = true;
+    }
+    pthread_mutex_unlock(&thread_arenas_lock);
+    if (a == NULL) {
+        return -1;
+    }
+    thread_arena = a;
+    pthread_setspecific(thread_arena_key, a);
+    return a - thread_arenas;
+}
+
+
+/**
+ * Choose the node arena the calling thread allocates from.
+ * @param node The NUMA node, or -1 for the node the thread is running on.
+ * @return Returns the node of the chosen arena, or -1 if NUMA arenas are not enabled.
+ */
+
+int mm_numa_bind(int node) {
+    if (num_node_arenas == 0) {
+        return -1;
+    }
+    if (node < 0) {
+        node = mem_numa_node();
+    }
+    thread_arena = &node_arenas[node % num_node_arenas];
+    return node % num_node_arenas;
+}
+
+/**
+ * Forget the learned lifetimes, as when the heap is reset.
+ */
+
+static void resetlifetimes() {
+    for (int cls = 0; cls < LIFETIME_CLASSES; cls++) {
+        atomic_store_explicit(&lifetime_score[cls], 0, memory_order_relaxed);
+    }
+    atomic_store(&lifetime_clock, 0);
+}
+
+
+/**
+ * Choose how blocks are placed by predicted lifetime. Predicted short-lived
+ * blocks go to an arena of their own, created the first time prediction is
+ * turned on; blocks already there stay until freed when it is turned off.
+ * @param mode MM_LIFETIME_OFF, or what to predict lifetimes from.
+ * @return Returns 1 if blocks are placed by lifetime, 0 if not.
+ */
+
+int mm_lifetime(MMLifetimeMode mode) {
+    mm_init();
+    if (mode != MM_LIFETIME_OFF && short_arena.region == NULL && !create_arena(&short_arena, -1)) {
+        mode = MM_LIFETIME_OFF;
+    }
+    lifetime_mode = mode;
+    return mode != MM_LIFETIME_OFF;
+}
+
+
+/**
+ * Find the prediction class of an allocation: a size class, with four
+ * classes per power of two, combined with the call site if predicted from sites.
+ * @param bytechunks The requested size.
+ * @param site The return address of the caller of mm_malloc.
+ * @return Returns the class, never 0.
+ */
+
+static uint32_t lifetimeclass(size_t bytechunks, void *site) {
+    uint32_t cls = bytechunks;
+    if (bytechunks >= 4) {
+        int e = 63 - __builtin_clzll(bytechunks);
+        cls = 4 * (e - 1) + ((bytechunks >> (e - 2)) & 3);
+    }
+    if (lifetime_mode == MM_LIFETIME_SITES) {
+        uint32_t hash = ((uintptr_t)site * 0x9E3779B97F4A7C15ull) >> 56;
+        cls = cls * 31 + hash;
+    }
+    return 1 + cls % (LIFETIME_CLASSES - 1);
+}
+
+
+/**
+ * Get the bytes in the heaps of all arenas. Heaps growing in other threads
+ * are read without locking them.
+ * @return Returns the total heap size.
+ */
+
+size_t mm_heap_bytes() {
+    size_t total = 0;
+    MemRegion *prev = mem_region_select(NULL);
+    total += mem_heapsize();
+    for (int i = 0; i < num_node_arenas; i++) {
+        mem_region_select(node_arenas[i].region);
+        total += mem_heapsize();
+    }
+    int n = atomic_load(&num_thread_arenas);
+    for (int i = 0; i < n; i++) {
+        mem_region_select(thread_arenas[i].region);
+        total += mem_heapsize();
+    }
+    if (short_arena.region != NULL) {
+        mem_region_select(short_arena.region);
+        total += mem_heapsize();
+    }
+    mem_region_select(prev);
+    return total;
+}
+
+/**
+ * Reinitialize the free list.
+ * Restart the heap structure with all the initial values set.
+ */
+
+static void restart() {
+    
+    if (mem_sbrk((blocks + 1) * sizeof(HeadFoot)) == (void *) -1) {
+        return;
+    }
+    arena->base = mem_heap_lo();
+    arena->freelist = arena->base;
+    arena->freelist[blocks-1].k.size_of_blk = blocks;      //Fixing the size of blocks.
+    arena->freelist->k.size_of_blk = blocks;
+    size_t num = 1;
+    arena->freelist[blocks-1].k.alloc_or_not = num;        //Marking blocks as allocated.
+    arena->freelist->k.alloc_or_not = num;
+    arena->freelist->k.next_free = 0;
+    arena->freelist->k.previous_free = 0;
+    HeadFoot *lastblck = arena->freelist + blocks;
+    lastblck->k.alloc_or_not = 1;                 //Marking last block as allocated.
+    lastblck->k.size_of_blk = 1;
+    memset(arena->fastbins, 0, sizeof(arena->fastbins));        //Forget blocks parked in the old heap.
+    arena->fastbin_bytes = 0;
+    atomic_store(&arena->remote_frees, NULL);
+    memset(&arena->stats, 0, sizeof(arena->stats));
+    arena->compact_from = 0;
+    arena->growth_chunk = 0;
+    arena->allocs = 0;
+    arena->allocs_at_growth = 0;
+}
+
+
+/**
+ * Take free block from the freelist.
+ * @param head The pointer which corresponds to the block.
+ */
+
+static void takefromlist(HeadFoot *head) {
+    
+    HeadFoot *after = nextfree(head);            //Fixing the pointer after the block which is to be removed.
+    HeadFoot *before = prevfree(head);           //Fixing the pointer before the block which is to be removed.
+    before->k.next_free = head->k.next_free;     //Pointing the previous block after the removed block.
+    after->k.previous_free = head->k.previous_free;  //Pointing the next block to the block before the removed block.
+}
+
+
+/**
+ * Convert the specified header sized chunks to bytes.
+ * @param headchunk The size to be converted in header chunks.
+ * @return Returns the equivalent size in bytes.
+ */
+
+static size_t conv_bytes(size_t headchunk) {
+    size_t bc = headchunk * sizeof(HeadFoot);
+    return bc;
+}
+
+
+/**
+ * Put the block back into the free list.
+ * Two cases:
+ * 1)Combine with lower adjacent block->Check if previous block is in freelist &
+ * Make the block into one bigger block.
+ * 2)Combine with upper adjacent block->Check if next part of memory is in freelist &
+ * Make the block into one bigger block.
+ * @param blockval The blocks which are allocated and needs to be freed.
+ */
+
+static void returnfreeblocktolist(HeadFoot *blockval) {
+    
+    size_t headch = blockval->k.size_of_blk;
+    blockval[headch-1].k.alloc_or_not = 0;          //Marking  blocks as free
+    blockval->k.alloc_or_not = 0;                 //Marking the first block as free
+    bool lower = (blockval[-1].k.alloc_or_not == 0);
+    if (lower) {             //Check if the block is not allocated
+        blockval = blockval - blockval[-1].k.size_of_blk;
+        headch = headch + blockval->k.size_of_blk;
+        blockval[headch-1].k.size_of_blk = headch;
+        blockval->k.size_of_blk = headch;
+    } else  {
+        HeadFoot *after = nextfree(arena->freelist);
+        uint32_t off = offsetof_block(blockval);
+        blockval->k.previous_free = offsetof_block(arena->freelist);
+        blockval->k.next_free = arena->freelist->k.next_free;     //Place the block after the specified block.
+        after->k.previous_free = off;
+        arena->freelist->k.next_free = off;
+    }
+    arena->freelist = blockval;
+    bool upper = (blockval[headch].k.alloc_or_not == 0);
+    if (upper) {
+        takefromlist(blockval+headch);          //Place the block with the upper blocks.
+        headch = headch + blockval[headch].k.size_of_blk;
+        blockval[headch-1].k.size_of_blk = headch;
+        blockval->k.size_of_blk = headch;
+    }
+    STAT(if (lower && upper) arena->stats.coalesce_both++;
+         else if (lower) arena->stats.coalesce_lower++;
+         else if (upper) arena->stats.coalesce_upper++;)
+    uint32_t off = offsetof_block(blockval);
+    if (off < arena->compact_from) {          //Compaction resumes at the new free block.
+        arena->compact_from = off;
+    }
+}
+
+
+/**
+ * Convert the specified bytes to header sized chunks.
+ * A size larger than any heap saturates rather than wrapping around to a small block.
+ * @param bytechunks The size to be converted in bytes.
+ * @return Returns header sized chunks, more than MAX_HEAP_UNITS if the size cannot fit.
+ */
+
+static size_t headchunksize(size_t bytechunks) {
+    if (bytechunks > conv_bytes(MAX_HEAP_UNITS)) {
+        return MAX_HEAP_UNITS + 1;
+    }
+    size_t hc = (bytechunks + sizeof(HeadFoot) - 1);
+    hc = hc / sizeof(HeadFoot);
+    return hc;
+}
+
+/**
+ * Find the least the heap grows by now, adapting it to the demand: the growth
+ * chunk doubles when the heap grows again soon after it last grew, and halves
+ * for each GROWTH_DECAY_ALLOCS allocations served since then. Bursts of
+ * allocations then extend the heap a few times rather than a page at a time.
+ * @return Returns the growth chunk in bytes, a multiple of the page size.
+ */
+
+static size_t growthchunk() {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t chunk = arena->growth_chunk;
+    size_t idle = (arena->allocs - arena->allocs_at_growth) / GROWTH_DECAY_ALLOCS;
+    if (chunk == 0) {
+        chunk = page;
+    } else if (idle == 0) {
+        chunk *= 2;
+    } else {
+        chunk = (idle < 8 * sizeof(size_t)) ? chunk >> idle : 0;
+    }
+    size_t cap = mem_heapsize() / 100 * GROWTH_HEAP_PERCENT;
+    if (cap > GROWTH_CHUNK_MAX) {
+        cap = GROWTH_CHUNK_MAX;
+    }
+    if (chunk > cap) {
+        chunk = cap;
+    }
+    chunk -= chunk % page;
+    if (chunk < page) {
+        chunk = page;
+    }
+    arena->growth_chunk = chunk;
+    arena->allocs_at_growth = arena->allocs;
+    return chunk;
+}
+
+
+/**
+ * Extend the heap of the current arena.
+ * @param bytecounts The bytes to add.
+ * @return Returns the start of the new storage, or (void *) -1 with errno set to ENOMEM
+ * if the heap cannot grow that much or its offsets would not fit.
+ */
+
+static void *extendheap(size_t bytecounts) {
+    if ((mem_heapsize() + bytecounts) / sizeof(HeadFoot) > MAX_HEAP_UNITS) {     //Offsets would not fit.
+        errno = ENOMEM;
+        return (void *) -1;
+    }
+    return mem_sbrk(bytecounts);
+}
+
+
+/**
+ * Increase heap size to include more free blocks.
+ * The heap grows by the growth chunk, or only by what is needed if the chunk does not fit below the maximum heap.
+ * @param heads The number of header sized units needed; a free block at the top counts toward them.
+ * @return Returns the free block at the top of the heap, or null if storage cannot be increased.
+ */
+
+static HeadFoot *increaseheapsize(size_t heads) {
+    HeadFoot *end = (HeadFoot *)((char *)mem_heap_lo() + mem_heapsize()) - 1;
+    if (end[-1].k.alloc_or_not == 0 && end[-1].k.size_of_blk < heads) {
+        heads -= end[-1].k.size_of_blk;     //The free block at the top merges with the new storage.
+    }
+    if (heads < blocks) {
+        heads = blocks;
+    }
+    size_t allocations = headchunksize(growthchunk());
+    void *incr = (void *) -1;
+    if (heads < allocations) {
+        incr = extendheap(conv_bytes(allocations));
+        if (incr != (void *) -1) {
+            heads = allocations;
+        }
+    }
+    if (incr == (void *) -1) {          //Near the maximum heap, grow by just what is needed.
+        incr = extendheap(conv_bytes(heads));
+    }
+    if (incr == (void *) -1) {          //cannot increase space
+        return NULL;
+    }
+    STAT(arena->stats.growth_calls++; arena->stats.growth_bytes += conv_bytes(heads);
+         if (conv_bytes(heads) > arena->stats.growth_max) arena->stats.growth_max = conv_bytes(heads);)
+    HeadFoot *blck = (HeadFoot*) incr - 1;
+    blck[heads-1].k.size_of_blk = heads;
+    blck->k.size_of_blk = heads;        //adjust the size of the block to the new size.
+    blck[heads-1].k.alloc_or_not = 0;   //Mark blocks free.
+    blck->k.alloc_or_not = 0;
+    blck[heads].k.alloc_or_not = 1;     //Mark last block as allocated.
+    blck[heads].k.size_of_blk = 1;      //Size of the last block
+    returnfreeblocktolist(blck);        //put the included storage to the list of free blocks.
+    return arena->freelist;                    //return the new free list.
+}
+
+
+/**
+ * Merge every block parked in the fast bins back into the free list.
+ */
+
+static void consolidatefastbins() {
+    for (size_t bin = 0; bin < NFASTBINS; bin++) {
+        HeadFoot *blck = arena->fastbins[bin];
+        while (blck != NULL) {
+            HeadFoot *next = nextparked(blck);
+            blck->k.previous_free = 0;          //No longer parked.
+            returnfreeblocktolist(blck);
+            blck = next;
+        }
+        arena->fastbins[bin] = NULL;
+    }
+    arena->fastbin_bytes = 0;
+}
+
+
+/**
+ * Called when the free list has no block large enough.
+ * Merges the fast bins back into the free list if anything is parked there,
+ * otherwise increases the heap size.
+ * @param heads The number of header sized units required.
+ * @return Returns the free list to search again, or null if storage cannot be increased.
+ */
+
+static HeadFoot *morefreeblocks(size_t heads) {
+    if (arena->fastbin_bytes > 0) {
+        consolidatefastbins();
+        return arena->freelist;
+    }
+    return increaseheapsize(heads);
+}
+
+
+/**
+ * Release an allocated block. Small blocks are parked in their fast bin
+ * without coalescing, others are returned to the free list.
+ * @param blck The allocated block to release.
+ */
+
+static void releaseblock(HeadFoot *blck) {
+    if (blck->k.sampled) {
+        blck->k.sampled = 0;
+        mm_profile_record_free(blck + 1);
+    }
+    size_t bin = blck->k.size_of_blk - blocks;
+    if (bin >= NFASTBINS) {
+        returnfreeblocktolist(blck);
+        return;
+    }
+    blck->k.previous_free = FASTBIN_MARK;       //Still marked allocated, so neighbors do not merge with it.
+    blck->k.next_free = (arena->fastbins[bin] == NULL) ? 0 : offsetof_block(arena->fastbins[bin]);
+    arena->fastbins[bin] = blck;
+    arena->fastbin_bytes += conv_bytes(blck->k.size_of_blk);
+    if (arena->fastbin_bytes > FASTBIN_CONSOLIDATE_BYTES) {
+        consolidatefastbins();
+    }
+}
+
+
+#ifdef MM_STATS
+/**
+ * Count a free list search in the statistics of the current arena.
+ * @param probes The number of free blocks the search visited.
+ */
+
+static void countprobes(size_t probes) {
+    MMStats *st = &arena->stats;
+    st->searches++;
+    st->probes += probes;
+    if (probes > st->max_probes) {
+        st->max_probes = probes;
+    }
+    size_t bucket = 0;
+    for (size_t p = probes; p > 1 && bucket < MM_PROBE_BUCKETS - 1; p >>= 1) {
+        bucket++;
+    }
+    st->probe_hist[bucket]++;
+}
+#endif
+
+
+/**
+ * Check whether a free block is the wilderness, the block at the top of
+ * the heap that can grow with the heap. Only the end block has size 1.
+ * @param blck The free block.
+ * @return Returns true if the end block follows it.
+ */
+
+static inline bool iswilderness(HeadFoot *blck) {
+    return blck[blck->k.size_of_blk].k.size_of_blk == 1;
+}
+
+
+/**
+ * Allocate from a free block, splitting off the rest of it if that is at least
+ * MIN_SPLIT_REMAINDER bytes. The rest of the wilderness, or of any block with
+ * SPLIT_HEAD, is the upper part, so it stays at the top and can be trimmed;
+ * otherwise the lower part stays free in place on the free list.
+ * @param blck The free block, large enough.
+ * @param headc The number of header chunks required.
+ * @return Returns the allocated block.
+ */
+
+static HeadFoot *placeblock(HeadFoot *blck, size_t headc) {
+    size_t total = blck->k.size_of_blk;
+    size_t minrest = headchunksize(MIN_SPLIT_REMAINDER);
+    if (minrest < blocks) {
+        minrest = blocks;
+    }
+    if (total - headc < minrest) {          //Too little left to split off: take the whole block.
+        if (blck == arena->freelist) {
+            arena->freelist = prevfree(blck);
+        }
+        takefromlist(blck);
+        blck[total-1].k.alloc_or_not = 1;   //Mark block as allocated.
+        blck->k.alloc_or_not = 1;
+        return blck;
+    }
+    STAT(arena->stats.splits++;)
+    if (SPLIT_HEAD || iswilderness(blck)) {
+        HeadFoot *rest = blck + headc;      //The rest takes the place of the block on the free list.
+        uint32_t off = offsetof_block(rest);
+        rest->k.previous_free = blck->k.previous_free;
+        rest->k.next_free = blck->k.next_free;
+        prevfree(blck)->k.next_free = off;
+        nextfree(blck)->k.previous_free = off;
+        if (blck == arena->freelist) {
+            arena->freelist = rest;
+        }
+        rest->k.size_of_blk = total - headc;
+        rest->k.alloc_or_not = 0;
+        rest->k.sampled = 0;
+        rest->k.grown = 0;
+        rest[total-headc-1].k.size_of_blk = total - headc;
+        rest[total-headc-1].k.alloc_or_not = 0;
+        blck->k.size_of_blk = headc;
+        blck->k.alloc_or_not = 1;
+        blck[headc-1].k.size_of_blk = headc;
+        blck[headc-1].k.alloc_or_not = 1;
+        return blck;
+    }
+    // The first block stays in the free list.
+    // The second block is allocated to the user.
+    size_t alc = total - headc;
+    blck->k.size_of_blk = alc;
+    blck[alc-1].k.size_of_blk = alc;
+    blck[alc].k.size_of_blk = headc;
+    blck[alc].k.alloc_or_not = 1;
+    blck[alc+headc-1].k.size_of_blk = headc;
+    blck[alc+headc-1].k.alloc_or_not = 1;
+    return blck + alc;
+}
+
+
+/**
+ * Find a free block from the free list using the first fit algorithm.
+ * With WILDERNESS_LAST, the free block at the top of the heap is used only
+ * if no other block fits, even after merging the fast bins.
+ * @param headc The number of header chunks required.
+ * @return a pointer which points to the start of the free blocks.
+ */
+static HeadFoot *pick_free_block_from_list_first_fit(size_t headc) {
+    HeadFoot *blck = arena->freelist;
+    HeadFoot *wilderness = NULL;
+    size_t wildleft = 0;                    //Blocks still to probe after finding the wilderness.
+    STAT(size_t probes = 0;)
+    while (true) {
+        STAT(probes++;)
+        if (( headc <= blck->k.size_of_blk) && (blck->k.alloc_or_not == 0)) {
+            if (!WILDERNESS_LAST || !iswilderness(blck)) {
+                STAT(countprobes(probes);)
+                return placeblock(blck, headc);
+            }
+            if (wilderness == NULL) {
+                wilderness = blck;          //Fits, but keep it for when nothing else does.
+                wildleft = WILDERNESS_PROBES;
+            }
+        }
+        if (wilderness != NULL && wildleft-- == 0) {
+            STAT(countprobes(probes);)
+            return placeblock(wilderness, headc);   //Looked long enough for another block.
+        }
+        blck = nextfree(blck);
+        if (blck == arena->freelist) {      //No other block is big enough.
+            if (arena->fastbin_bytes > 0) {
+                consolidatefastbins();      //Merging parked blocks may make one, and may merge into the wilderness.
+                wilderness = NULL;
+                blck = arena->freelist;
+                continue;
+            }
+            if (wilderness == NULL) {
+                wilderness = increaseheapsize(headc);   //Grows the free block at the top if there is one.
+                if (wilderness == NULL) {
+                    return NULL;
+                }
+            }
+            STAT(countprobes(probes);)
+            return placeblock(wilderness, headc);
+        }
+    }
+}
+
+/**
+ * Find a free block from the free list using the best fit algorithm.
+ * @param headc The number of header chunks required.
+ * @return a pointer which points to the start of the free blocks.
+ */
+static HeadFoot *pick_free_block_from_list_best_fit(size_t headc) {
+    int count = 0;
+    HeadFoot *temp = arena->freelist;
+    HeadFoot *best_fit = arena->freelist;
+    HeadFoot *val = arena->freelist;
+    //Finds the best fit block by traversing through the free list.
+    while(true) {
+        if (arena->freelist != NULL) {
+            do {
+                if ((headc <= temp->k.size_of_blk)
+                    && (temp->k.alloc_or_not == 0)
+                    && (temp->k.size_of_blk < best_fit->k.size_of_blk)) {
+                    best_fit = temp;
+                }
+                temp = nextfree(temp);
+                count++;
+            } while (temp != arena->freelist);
+        }
+        if (best_fit == val) {
+            if (temp == NULL) {
+                return NULL;
+            }
+            break;
+        } else {
+            break;
+        }
+    }
+    HeadFoot *blck = best_fit;
+    while (true) {
+        if (( headc <= blck->k.size_of_blk) && (blck->k.alloc_or_not == 0)) {
+            return placeblock(blck, headc);
+        }
+        blck = nextfree(blck);
+        if (blck == arena->freelist) {
+            blck = morefreeblocks(headc);   //Increase storage since we cannot find a block which is big enough.
+            if (blck == NULL) {
+                return NULL;
+            }
+        }
+    }
+}
+
+/**
+ * Allocates the specified size from the current arena.
+ * @param bytechunks The total amount of bytes which we need to allocate to our storage.
+ * @return Returns a pointer to the allocated memory if storage was available or returns null if allocation was not possible.
+ */
+
+static void *allocate(size_t bytechunks) {
+    if (arena->freelist == NULL) {         //Initialize if not already initialized.
+        mm_init();
+    }
+    arena->allocs++;
+    size_t chunks = headchunksize(bytechunks);
+    chunks = chunks + 2;   //Header & Footer is always added.
+    if (blocks > chunks) {
+        chunks = blocks;
+    }
+    size_t bin = chunks - blocks;
+    if (bin < NFASTBINS && arena->fastbins[bin] != NULL) {     //Reuse a parked block of the same size.
+        HeadFoot *headptr = arena->fastbins[bin];
+        arena->fastbins[bin] = nextparked(headptr);
+        arena->fastbin_bytes -= conv_bytes(chunks);
+        STAT(arena->stats.fastbin_hits++;)
+        headptr->k.previous_free = 0;
+        headptr->k.next_free = 0;
+        headptr->k.sampled = 0;
+        headptr->k.grown = 0;
+        return headptr + 1;
+    }
+    HeadFoot *headptr = pick_free_block_from_list_first_fit(chunks);  //Get a block based on first fit algorithm.
+   //  HeadFoot *headptr = pick_free_block_from_list_best_fit(chunks); //Get a block based on best fit algorithm.
+    if (headptr == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    headptr->k.previous_free = 0;           //Header may hold a stale fast bin mark.
+    headptr->k.next_free = 0;               //Or a stale free list link, read as a lifetime stamp.
+    headptr->k.sampled = 0;
+    headptr->k.grown = 0;
+    return headptr + 1;         //pointer to the allocated memory.
+}
+
+
+/**
+ * Find the required block if it was allocated.
+ * @param allocated The allocated block pointer.
+ * @return if pointer does not reside within allocated block returns null or returns the pointer to allocated block.
+ */
+
+static HeadFoot *allocatedblock(void *allocated) {
+    if (allocated <= mem_heap_lo() || allocated >= mem_heap_hi() || allocated == NULL) {        //If the pointer is not within bounds or invalid.
+        return NULL;
+    }
+    HeadFoot *blck_list;
+    if (((char *)allocated - (char *)mem_heap_lo()) % sizeof(HeadFoot) == 0)  {
+        blck_list = (HeadFoot*)allocated-1;
+        if (blck_list->k.previous_free == FASTBIN_MARK || blck_list->k.previous_free == HANDLE_MARK
+            || blck_list->k.previous_free == REMOTE_MARK) {
+            return NULL;        //Already freed into a fast bin or a remote free list, or only reached through its handle.
+        }
+        if (blck_list->k.alloc_or_not == 1) {     //Check if the block is allocated.
+            size_t headvals = blck_list->k.size_of_blk;
+            if (blocks <= headvals) {
+                if (   (blck_list->k.size_of_blk == blck_list[headvals-1].k.size_of_blk)
+                    || (blck_list->k.alloc_or_not == blck_list[headvals-1].k.alloc_or_not)) {
+                    return blck_list;
+                }
+            }
+        }
+    }
+    blck_list = mem_heap_lo();
+    for (HeadFoot *proceed = blck_list + blck_list->k.size_of_blk; (void *)proceed <= allocated; proceed = proceed + blck_list->k.size_of_blk) {
+        blck_list = proceed;   //move the block pointer until the required position is reached.
+    }
+    
+    if(blck_list->k.alloc_or_not == 1 && blck_list->k.previous_free != FASTBIN_MARK
+       && blck_list->k.previous_free != HANDLE_MARK && blck_list->k.previous_free != REMOTE_MARK) {
+        return blck_list; //returns the block which was allocated.
+    }
+    else {
+        return NULL;
+    }
+}
+
+
+/**
+ * Set the size of an allocated block and split off the rest of its
+ * storage as a free block if that is large enough to be one.
+ * @param blck The allocated block.
+ * @param total The number of header chunks the block spans now.
+ * @param headc The number of header chunks the block should keep.
+ */
+
+static void trimblock(HeadFoot *blck, size_t total, size_t headc) {
+    if (total < headc + blocks) {           //Too little left over to be a block.
+        headc = total;
+    }
+    blck->k.size_of_blk = headc;
+    blck[headc-1].k.size_of_blk = headc;
+    blck[headc-1].k.alloc_or_not = 1;
+    if (headc < total) {
+        HeadFoot *rest = blck + headc;
+        rest->k.size_of_blk = total - headc;
+        rest[total-headc-1].k.size_of_blk = total - headc;
+        rest->k.alloc_or_not = 1;
+        rest[total-headc-1].k.alloc_or_not = 1;
+        rest->k.sampled = 0;
+        STAT(arena->stats.splits++;)
+        returnfreeblocktolist(rest);        //Coalesces with a free block above.
+    }
+}
+
+
+/**
+ * Grow an allocated block into the free block above it, extending the
+ * heap first if the block is the last one or the wilderness above it is
+ * too small, so that a large block at the top never has to be copied.
+ * The block keeps its header, and so its lifetime stamp.
+ * @param blck The allocated block.
+ * @param need The number of header chunks required.
+ * @param want The number of header chunks wanted, at least need.
+ * @return Returns true if the block now has at least need header chunks.
+ */
+
+static bool growinplace(HeadFoot *blck, size_t need, size_t want) {
+    size_t insize = blck->k.size_of_blk;
+    HeadFoot *upper = blck + insize;
+    if ((upper->k.alloc_or_not == 1 && upper->k.size_of_blk == 1)      //Block is last in the heap,
+        || (upper->k.alloc_or_not == 0 && iswilderness(upper)          //or below a wilderness too small.
+            && insize + upper->k.size_of_blk < need)) {
+        if (increaseheapsize(want - insize) == NULL) {
+            return false;
+        }
+    }
+    if (upper->k.alloc_or_not != 0 || insize + upper->k.size_of_blk < need) {
+        return false;
+    }
+    if (upper == arena->freelist) {
+        arena->freelist = prevfree(upper);
+    }
+    takefromlist(upper);
+    if (arena->compact_from == offsetof_block(upper)) {     //Compaction was to resume at the merged block.
+        arena->compact_from = offsetof_block(blck);
+    }
+    trimblock(blck, insize + upper->k.size_of_blk, want);
+    return true;
+}
+
+
+/**
+ * Reallocates storage of the current arena.
+ * A block is grown in place if possible, and a block grown more than once
+ * is given headroom for its next growth. Shrinking a block frees its tail.
+ * @param allocatedptr The present storage which was allocated.
+ * @param bytechunks The storage size which needs to be resized to this specified size.
+ * @return Returns the new storage location or null if not possible.
+ */
+
+static void *reallocate(void *allocatedptr, size_t bytechunks) {
+    HeadFoot *blockv = allocatedblock(allocatedptr);  //Get the allocated block which is to be reallocated.
+    if (blockv == NULL) {            //If the required block is not available set errno.
+        errno = EFAULT;
+        return NULL;
+    }
+    size_t hchunks = headchunksize(bytechunks);
+    hchunks = hchunks + 2;
+    if (blocks > hchunks) {
+        hchunks = blocks;
+    }
+    size_t insize = blockv->k.size_of_blk;
+    if (insize >= hchunks) {
+        if (!blockv->k.grown || 2 * hchunks < insize) {     //Keep the headroom of a growing block.
+            trimblock(blockv, insize, hchunks);
+        }
+        return allocatedptr;
+    }
+    size_t want = hchunks;
+    if (blockv->k.grown) {
+        want = hchunks + hchunks * REALLOC_HEADROOM_PERCENT / 100;
+    }
+    if (growinplace(blockv, hchunks, want)) {
+        blockv->k.grown = 1;
+        return allocatedptr;
+    }
+    HeadFoot *reblockptr = pick_free_block_from_list_first_fit(want);  //Get a block based on first fit algorithm.
+    // HeadFoot *reblockptr = pick_free_block_from_list_best_fit(want);     //Get a block based on best fit algorithm.
+    if (reblockptr == NULL && want > hchunks) {
+        reblockptr = pick_free_block_from_list_first_fit(hchunks);      //Without the headroom.
+    }
+    if (reblockptr == NULL) {
+        return NULL;
+    }
+    reblockptr->k.previous_free = 0;           //Header may hold a stale fast bin mark.
+    reblockptr->k.next_free = 0;               //Or a stale free list link, read as a lifetime stamp.
+    reblockptr->k.sampled = 0;
+    reblockptr->k.grown = 1;
+    size_t copysize = insize - 2;
+    void *newloc =reblockptr + 1;  //The new payload is received.
+    size_t copybytes = conv_bytes(copysize); //Convert the header chunks to corresponding bytes.
+    memcpy(newloc, allocatedptr, copybytes); //copy to the new location.
+    atomic_fetch_add_explicit(&realloc_copied, copybytes, memory_order_relaxed);
+    STAT(arena->stats.realloc_copies++; arena->stats.realloc_copy_bytes += copybytes;)
+    releaseblock(blockv);          //return the old allocated storage to the free list.
+    return newloc;                 //return the new storage location.
+}
+
+
+/**
+ * Learn from the lifetime of a block being freed.
+ * @param blck The allocated block, stamped when it was allocated.
+ */
+
+static void learnlifetime(HeadFoot *blck) {
+    uint32_t cls = blck->k.next_free % LIFETIME_CLASSES;
+    if (cls == 0) {             //Allocated before prediction was turned on, or moved by realloc.
+        return;
+    }
+    uint32_t now = (atomic_load_explicit(&lifetime_clock, memory_order_relaxed) / LIFETIME_UNIT) & LIFETIME_STAMP_MASK;
+    uint32_t age = (now - blck->k.next_free / LIFETIME_CLASSES) & LIFETIME_STAMP_MASK;
+    bool young = (size_t)age * LIFETIME_UNIT < SHORT_LIFETIME;
+    int score = atomic_load_explicit(&lifetime_score[cls], memory_order_relaxed);
+    score = young ? score + 1 : score - 2;      //A survivor among short blocks costs more than the reverse.
+    if (score > LIFETIME_MAX_SCORE) {
+        score = LIFETIME_MAX_SCORE;
+    } else if (score < -LIFETIME_MAX_SCORE) {
+        score = -LIFETIME_MAX_SCORE;
+    }
+    atomic_store_explicit(&lifetime_score[cls], score, memory_order_relaxed);   //Racing updates may be lost.
+    STAT(if (arena == &short_arena && !young) arena->stats.short_survivors++;
+         else if (arena != &short_arena && young) arena->stats.missed_short++;)
+}
+
+
+/**
+ * Frees storage of the current arena.
+ * @param alloc The storage which was allocated to be freed.
+ */
+
+static void deallocate(void *alloc) {
+    HeadFoot *heaf = allocatedblock(alloc);  //Get the allocated block which is to be freed.
+    if (heaf == NULL) {             //If the required block is not available set errno.
+        errno = EFAULT;
+    } else {            //return the allocated block to the list of free blocks.
+        if (lifetime_mode != MM_LIFETIME_OFF) {
+            learnlifetime(heaf);
+        }
+        releaseblock(heaf);
+    }
+}
+
+
+/** A free block and its position on the free list */
+typedef struct {
+    HeadFoot *blck;
+    int32_t pos;
+} FreePos;
+
+
+/**
+ * Order free list positions by block address.
+ * @param a The first position.
+ * @param b The second position.
+ * @return Returns the order of their blocks.
+ */
+
+static int comparefreepos(const void *a, const void *b) {
+    HeadFoot *x = ((const FreePos *)a)->blck;
+    HeadFoot *y = ((const FreePos *)b)->blck;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Write the blocks of the current arena from the start of its heap.
+ * The free list is walked from the initial block, which never moves.
+ * @param out The stream to write to.
+ * @param tag The label to store in the snapshot.
+ * @return Returns the number of blocks written, or -1 if the write failed.
+ */
+
+static long snapshot(FILE *out, uint64_t tag) {
+    HeadFoot *first = mem_heap_lo();
+    MMSnapshotHeader header = { MM_SNAPSHOT_MAGIC, tag, mem_heapsize(), 0 };
+    if (arena->freelist == NULL) {          //No heap yet.
+        return (fwrite(&header, sizeof(header), 1, out) == 1) ? 0 : -1;
+    }
+
+    size_t nfree = 0;
+    for (HeadFoot *p = nextfree(first); p != first; p = nextfree(p)) {
+        nfree++;
+    }
+    FreePos *freepos = malloc((nfree + 1) * sizeof(FreePos));
+    if (freepos == NULL) {
+        return -1;
+    }
+    nfree = 0;
+    for (HeadFoot *p = nextfree(first); p != first; p = nextfree(p), nfree++) {
+        freepos[nfree].blck = p;
+        freepos[nfree].pos = (int32_t)nfree;
+    }
+    qsort(freepos, nfree, sizeof(FreePos), comparefreepos);
+
+    for (HeadFoot *p = first + first->k.size_of_blk; p->k.size_of_blk != 1; p += p->k.size_of_blk) {
+        header.nblocks++;
+    }
+    long written = -1;
+    if (fwrite(&header, sizeof(header), 1, out) == 1) {
+        written = 0;
+        size_t f = 0;
+        for (HeadFoot *p = first + first->k.size_of_blk; p->k.size_of_blk != 1; p += p->k.size_of_blk) {
+            MMSnapshotBlock block = { (char *)p - (char *)first, conv_bytes(p->k.size_of_blk), MM_BLOCK_ALLOCATED, -1 };
+            if (p->k.alloc_or_not == 0) {
+                while (f < nfree && freepos[f].blck < p) {
+                    f++;
+                }
+                block.state = MM_BLOCK_FREE;
+                block.freepos = (f < nfree && freepos[f].blck == p) ? freepos[f].pos : -1;
+            } else if (p->k.previous_free == FASTBIN_MARK) {
+                block.state = MM_BLOCK_PARKED;
+            }
+            if (fwrite(&block, sizeof(block), 1, out) != 1) {
+                written = -1;
+                break;
+            }
+            written++;
+        }
+    }
+    free(freepos);
+    return written;
+}
+
+
+/**
+ * Count the free bytes of the current arena: its free blocks and the blocks parked in its fast bins.
+ * @return Returns the free bytes.
+ */
+
+static size_t freebytes() {
+    if (arena->freelist == NULL) {          //No heap yet.
+        return 0;
+    }
+    HeadFoot *first = mem_heap_lo();
+    size_t total = arena->fastbin_bytes;
+    for (HeadFoot *p = nextfree(first); p != first; p = nextfree(p)) {
+        total += conv_bytes(p->k.size_of_blk);
+    }
+    return total;
+}
+
+
+/**
+ * Calculate the free memory of the arena the calling thread allocates from.
+ * @return Returns the bytes in free blocks and in blocks parked in the fast bins.
+ */
+
+size_t mm_getfree(void) {
+    if (!arenas_enabled()) {
+        return freebytes();
+    }
+    Arena *prev = arena_enter(local_arena());
+    drain_remote_frees();
+    size_t total = freebytes();
+    arena_leave(prev);
+    return total;
+}
+
+
+/**
+ * Write a snapshot of the heap layout of the arena the calling thread allocates from.
+ * @param out The stream to write to.
+ * @param tag The label to store in the snapshot.
+ * @return Returns the number of blocks written, or -1 if the write failed.
+ */
+
+long mm_heap_snapshot(FILE *out, uint64_t tag) {
+    if (!arenas_enabled()) {
+        return snapshot(out, tag);
+    }
+    Arena *prev = arena_enter(local_arena());
+    drain_remote_frees();
+    long written = snapshot(out, tag);
+    arena_leave(prev);
+    return written;
+}
+
+
+/**
+ * Open a heap in a region mapped from a file, memfd or shared memory object.
+ * An empty file gets an empty heap of the given size; otherwise the heap
+ * already in the file is used as it is.
+ * @param fd The open file, readable and writable.
+ * @param size The size of the mapping of an empty file.
+ * @return Returns the shared heap, or null if it could not be mapped.
+ */
+
+MMSharedHeap *mm_shared_open(int fd, size_t size) {
+    MMSharedHeap *h = calloc(1, sizeof(MMSharedHeap));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->arena.region = mem_region_map(fd, size);
+    if (h->arena.region == NULL) {
+        free(h);
+        return NULL;
+    }
+    SharedState *st = mem_region_userdata(h->arena.region);
+    h->arena.shared = st;
+    if (memcmp(st->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0) {      //Initialize a new heap.
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&st->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        Arena *prev = arena_enter(&h->arena);
+        mem_reset_brk();
+        restart();
+        st->root = 0;
+        memcpy(st->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+        arena_leave(prev);
+    } else {
+        Arena *prev = arena_enter(&h->arena);       //Set the base of the local view.
+        arena_leave(prev);
+    }
+    return h;
+}
+
+
+/**
+ * Unmap a shared heap. The heap stays in its file.
+ * @param h The shared heap.
+ */
+
+void mm_shared_close(MMSharedHeap *h) {
+    if (h == NULL) {
+        return;
+    }
+    mem_region_destroy(h->arena.region);
+    free(h);
+}
+
+
+/**
+ * Allocates the specified size from a shared heap.
+ * @param h The shared heap.
+ * @param bytechunks The number of bytes to allocate.
+ * @return Returns a pointer to the allocated memory or null if allocation was not possible.
+ */
+
+void *mm_shared_malloc(MMSharedHeap *h, size_t bytechunks) {
+    Arena *prev = arena_enter(&h->arena);
+    void *allocated = allocate(bytechunks);
+    arena_leave(prev);
+    return allocated;
+}
+
+
+/**
+ * Reallocates storage of a shared heap.
+ * @param h The shared heap.
+ * @param allocatedptr The storage to resize, or null to allocate.
+ * @param bytechunks The new size in bytes.
+ * @return Returns the new storage location or null if not possible.
+ */
+
+void *mm_shared_realloc(MMSharedHeap *h, void *allocatedptr, size_t bytechunks) {
+    Arena *prev = arena_enter(&h->arena);
+    void *newloc = (allocatedptr == NULL) ? allocate(bytechunks) : reallocate(allocatedptr, bytechunks);
+    arena_leave(prev);
+    return newloc;
+}
+
+
+/**
+ * Frees storage of a shared heap.
+ * @param h The shared heap.
+ * @param alloc The storage to free, or null.
+ */
+
+void mm_shared_free(MMSharedHeap *h, void *alloc) {
+    if (alloc == NULL) {
+        return;
+    }
+    Arena *prev = arena_enter(&h->arena);
+    deallocate(alloc);
+    arena_leave(prev);
+}
+
+
+/**
+ * Get the offset of storage in a shared heap, which names it in every process.
+ * @param h The shared heap.
+ * @param allocated The storage, or null.
+ * @return Returns the offset in bytes, or zero for null.
+ */
+
+size_t mm_shared_offset(MMSharedHeap *h, const void *allocated) {
+    return (allocated == NULL) ? 0 : (size_t)((const char *)allocated - (const char *)h->arena.base);
+}
+
+
+/**
+ * Get the storage at an offset in a shared heap.
+ * @param h The shared heap.
+ * @param offset The offset from mm_shared_offset.
+ * @return Returns the storage, or null for offset zero.
+ */
+
+void *mm_shared_pointer(MMSharedHeap *h, size_t offset) {
+    return (offset == 0) ? NULL : (char *)h->arena.base + offset;
+}
+
+
+/**
+ * Get the root storage of a shared heap, from which its users find their data.
+ * @param h The shared heap.
+ * @return Returns the root storage, or null if none was set.
+ */
+
+void *mm_shared_root(MMSharedHeap *h) {
+    return mm_shared_pointer(h, h->arena.shared->root);
+}
+
+
+/**
+ * Set the root storage of a shared heap.
+ * @param h The shared heap.
+ * @param allocated The new root storage, or null.
+ */
+
+void mm_shared_set_root(MMSharedHeap *h, void *allocated) {
+    Arena *prev = arena_enter(&h->arena);
+    h->arena.shared->root = mm_shared_offset(h, allocated);
+    arena_leave(prev);
+}
+
+
+/**
+ * Write the main heap to a file, to be mapped back by mm_restore.
+ * @param path The file to write.
+ * @param root The storage from which the data in the heap is found, or null.
+ * @return Returns 0 if the heap was written, otherwise -1 with errno set.
+ */
+
+int mm_persist(const char *path, void *root) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    Arena *prev = arena_enter(&main_arena);
+    if (arena->freelist == NULL) {
+        mm_init();
+    }
+    PersistHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PERSIST_MAGIC, sizeof(PERSIST_MAGIC));
+    header.unit = sizeof(HeadFoot);
+    header.nfastbins = NFASTBINS;
+    header.heapsize = mem_heapsize();
+    header.freelist = offsetof_block(arena->freelist);
+    for (int bin = 0; bin < NFASTBINS; bin++) {
+        header.fastbins[bin] = (arena->fastbins[bin] == NULL) ? 0 : offsetof_block(arena->fastbins[bin]);
+    }
+    header.fastbin_bytes = arena->fastbin_bytes;
+    header.root = (root == NULL) ? 0 : (uint64_t)((char *)root - (char *)arena->base);
+
+    //Size the file first, so the rest of the header page reads as zeros.
+    int result = (ftruncate(fd, PERSIST_HEADER + header.heapsize) == 0) ? 0 : -1;
+    const char *data = (const char *)&header;
+    size_t len = sizeof(header);
+    off_t offset = 0;
+    for (int part = 0; part < 2 && result == 0; part++) {
+        while (len > 0) {                       //Write the header, then the heap on the page after it.
+            ssize_t n = pwrite(fd, data, len, offset);
+            if (n < 0) {
+                result = -1;
+                break;
+            }
+            data += n;
+            len -= n;
+            offset += n;
         }
+        data = mem_heap_lo();
+        len = header.heapsize;
+        offset = PERSIST_HEADER;
     }
-    blck_list = mem_heap_lo();
-    for (HeadFoot *proceed = blck_list + blck_list->k.size_of_blk; (void *)proceed <= allocated; proceed = proceed + blck_list->k.size_of_blk) {
-        blck_list = proceed;   //move the block pointer until the required position is reached.
+    arena_leave(prev);
+    if (close(fd) != 0) {
+        result = -1;
     }
-    
-    if(blck_list->k.alloc_or_not == 1) {
-        return blck_list; //returns the block which was allocated.
+    return result;
+}
+
+
+/**
+ * Replace the main heap with one written by mm_persist. The file is
+ * mapped copy-on-write: its pages are read as they are touched and
+ * changes to the heap do not reach the file.
+ * @param path The file to map.
+ * @param root Set to the root storage given to mm_persist, if not null.
+ * @return Returns 0 if the heap was restored, otherwise -1 with errno set and the heap unchanged.
+ */
+
+int mm_restore(const char *path, void **root) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
     }
-    else {
+    PersistHeader header;
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.magic, PERSIST_MAGIC, sizeof(PERSIST_MAGIC)) != 0
+        || header.unit != sizeof(HeadFoot) || header.nfastbins != NFASTBINS) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    Arena *prev = arena_enter(&main_arena);
+    int result = mem_restore(fd, PERSIST_HEADER, header.heapsize);
+    if (result == 0) {
+        arena->base = mem_heap_lo();
+        arena->freelist = blockat(header.freelist);
+        for (int bin = 0; bin < NFASTBINS; bin++) {
+            arena->fastbins[bin] = (header.fastbins[bin] == 0) ? NULL : blockat(header.fastbins[bin]);
+        }
+        arena->fastbin_bytes = header.fastbin_bytes;
+        atomic_store(&arena->remote_frees, NULL);
+        memset(&arena->stats, 0, sizeof(arena->stats));
+        arena->compact_from = 0;
+        arena->growth_chunk = 0;
+        arena->allocs = 0;
+        arena->allocs_at_growth = 0;
+        resethandles();
+        if (root != NULL) {
+            *root = (header.root == 0) ? NULL : (char *)arena->base + header.root;
+        }
+    }
+    arena_leave(prev);
+    close(fd);
+    return result;
+}
+
+
+/**
+ * Forget every handle, as when the main heap is reset.
+ */
+
+static void resethandles() {
+    free(handles);
+    handles = NULL;
+    handle_count = 0;
+    handle_capacity = 0;
+    free_handles = 0;
+}
+
+
+/**
+ * Take an unused entry of the handle table, growing the table if needed.
+ * @return Returns the handle, or 0 if the table cannot grow.
+ */
+
+static MMHandle newhandle() {
+    if (free_handles != 0) {
+        MMHandle h = free_handles;
+        free_handles = handles[h].locks;
+        return h;
+    }
+    if (handle_count == 0) {
+        handle_count = 1;                       //Entry 0 is never handed out.
+    }
+    if (handle_count >= handle_capacity) {
+        size_t capacity = (handle_capacity == 0) ? 64 : 2 * (size_t)handle_capacity;
+        if (capacity > UINT32_MAX) {
+            capacity = UINT32_MAX;
+        }
+        HandleEntry *table = (capacity > handle_capacity) ? realloc(handles, capacity * sizeof(HandleEntry)) : NULL;
+        if (table == NULL) {
+            return 0;
+        }
+        handles = table;
+        handle_capacity = capacity;
+    }
+    return handle_count++;
+}
+
+
+/**
+ * Find the entry of a handle in use.
+ * @param h The handle.
+ * @return Returns the entry, or null with errno set to EINVAL if the handle is not in use.
+ */
+
+static HandleEntry *handleentry(MMHandle h) {
+    if (h == 0 || h >= handle_count || handles[h].block == 0) {
+        errno = EINVAL;
         return NULL;
     }
+    return &handles[h];
+}
+
+
+/**
+ * Allocate a movable block. The block is reached through its handle:
+ * mm_hlock gives its address and keeps it there until mm_hunlock.
+ * @param bytechunks The number of bytes required.
+ * @return Returns the handle, or 0 if the storage is not available.
+ */
+
+MMHandle mm_halloc(size_t bytechunks) {
+    Arena *prev = arena_enter(&main_arena);
+    MMHandle h = 0;
+    void *allocated = allocate(bytechunks);
+    if (allocated != NULL) {
+        HeadFoot *blck = (HeadFoot *)allocated - 1;
+        h = newhandle();
+        if (h == 0) {
+            releaseblock(blck);
+            errno = ENOMEM;
+        } else {
+            blck->k.previous_free = HANDLE_MARK;
+            blck->k.next_free = h;
+            handles[h].block = offsetof_block(blck);
+            handles[h].locks = 0;
+            if (blck[-1].k.alloc_or_not == 0) {         //Split from the top of a free block.
+                uint32_t below = offsetof_block(blck - blck[-1].k.size_of_blk);
+                if (below < arena->compact_from) {
+                    arena->compact_from = below;
+                }
+            }
+        }
+    }
+    arena_leave(prev);
+    return h;
+}
+
+
+/**
+ * Pin a movable block so that compaction leaves it where it is.
+ * Locks nest: the block may move again once every lock is unlocked.
+ * @param h The handle of the block.
+ * @return Returns the storage of the block, or null with errno set if the handle is not in use.
+ */
+
+void *mm_hlock(MMHandle h) {
+    Arena *prev = arena_enter(&main_arena);
+    void *allocated = NULL;
+    HandleEntry *e = handleentry(h);
+    if (e != NULL) {
+        e->locks++;
+        allocated = blockat(e->block) + 1;
+    }
+    arena_leave(prev);
+    return allocated;
+}
+
+
+/**
+ * Undo an mm_hlock of a movable block. Its storage address may
+ * no longer be used once the block is unlocked.
+ * @param h The handle of the block.
+ */
+
+void mm_hunlock(MMHandle h) {
+    Arena *prev = arena_enter(&main_arena);
+    HandleEntry *e = handleentry(h);
+    if (e != NULL && e->locks > 0) {
+        e->locks--;
+    } else if (e != NULL) {
+        errno = EINVAL;
+    }
+    arena_leave(prev);
+}
+
+
+/**
+ * Free a movable block and its handle, whether or not it is locked.
+ * @param h The handle of the block.
+ */
+
+void mm_hfree(MMHandle h) {
+    Arena *prev = arena_enter(&main_arena);
+    HandleEntry *e = handleentry(h);
+    if (e != NULL) {
+        HeadFoot *blck = blockat(e->block);
+        blck->k.previous_free = 0;
+        blck->k.next_free = 0;
+        releaseblock(blck);
+        e->block = 0;
+        e->locks = free_handles;
+        free_handles = h;
+    }
+    arena_leave(prev);
+}
+
+
+/**
+ * Check whether compaction may move a block.
+ * @param blck The block.
+ * @return Returns true if the block is a movable block that is not locked.
+ */
+
+static bool movable(HeadFoot *blck) {
+    if (blck->k.alloc_or_not != 1 || blck->k.previous_free != HANDLE_MARK) {
+        return false;
+    }
+    uint32_t h = blck->k.next_free;
+    return h < handle_count && handles[h].block == offsetof_block(blck) && handles[h].locks == 0;
+}
+
+
+/**
+ * Move a movable block down into the free block just below it.
+ * @param hole The free block.
+ * @param blck The movable block above it.
+ * @return Returns the free block left above the moved block.
+ */
+
+static HeadFoot *slideblock(HeadFoot *hole, HeadFoot *blck) {
+    size_t holesize = hole->k.size_of_blk;
+    size_t blcksize = blck->k.size_of_blk;
+    if (hole == arena->freelist) {
+        arena->freelist = prevfree(hole);
+    }
+    takefromlist(hole);
+    memmove(hole, blck, conv_bytes(blcksize));
+    handles[hole->k.next_free].block = offsetof_block(hole);
+    STAT(arena->stats.compact_moves++; arena->stats.compact_bytes += conv_bytes(blcksize);)
+
+    HeadFoot *rest = hole + blcksize;
+    rest->k.size_of_blk = holesize;
+    rest->k.sampled = 0;
+    rest->k.grown = 0;
+    rest[holesize-1].k.size_of_blk = holesize;
+    returnfreeblocktolist(rest);                //Merges with a free block above.
+    return rest;
+}
+
+
+/**
+ * Give back the free block at the top of the heap if it is at least
+ * TRIM_THRESHOLD bytes, leaving the end block in its place.
+ * @return Returns the bytes the heap shrank by.
+ */
+
+static size_t trimheap() {
+    HeadFoot *end = (HeadFoot *)((char *)mem_heap_lo() + mem_heapsize()) - 1;
+    HeadFoot *top = end - end[-1].k.size_of_blk;
+    if (end[-1].k.alloc_or_not != 0 || conv_bytes(top->k.size_of_blk) < TRIM_THRESHOLD) {
+        return 0;
+    }
+    size_t bytecounts = conv_bytes(top->k.size_of_blk);
+    if (top == arena->freelist) {
+        arena->freelist = prevfree(top);
+    }
+    takefromlist(top);
+    mem_sbrk(-(ptrdiff_t)bytecounts);
+    top->k.size_of_blk = 1;                     //The new end block.
+    top->k.alloc_or_not = 1;
+    top->k.sampled = 0;
+    top->k.grown = 0;
+    top->k.previous_free = 0;
+    top->k.next_free = 0;
+    STAT(arena->stats.trim_calls++; arena->stats.trim_bytes += bytecounts;)
+    return bytecounts;
+}
+
+
+/**
+ * Compact the main heap by sliding unlocked movable blocks down into the
+ * free blocks below them, so the free space collects at the top, then trim
+ * the heap. The pass starts where the previous one stopped, or lower if a
+ * block was freed there since.
+ * @param budget The most bytes to move before stopping, or 0 for no limit.
+ * At least one block is moved even if it is larger than the budget.
+ * @return Returns 1 if the pass reached the top of the heap, 0 if it stopped on the budget.
+ */
+
+int mm_compact(size_t budget) {
+    Arena *prev = arena_enter(&main_arena);
+    if (arena->freelist == NULL) {
+        arena_leave(prev);
+        return 1;
+    }
+    if (arena->fastbin_bytes > 0) {
+        consolidatefastbins();
+    }
+    HeadFoot *end = (HeadFoot *)((char *)mem_heap_lo() + mem_heapsize()) - 1;
+    HeadFoot *blck = blockat(arena->compact_from);
+    size_t moved = 0;
+    while (blck < end) {
+        HeadFoot *upper = blck + blck->k.size_of_blk;
+        if (blck->k.alloc_or_not == 0 && movable(upper)) {
+            size_t bytecounts = conv_bytes(upper->k.size_of_blk);
+            if (budget > 0 && moved > 0 && moved + bytecounts > budget) {
+                break;
+            }
+            moved += bytecounts;
+            blck = slideblock(blck, upper);
+        } else {
+            blck = upper;
+        }
+    }
+    int done = (blck >= end);
+    if (done) {
+        trimheap();
+        arena->compact_from = 0;
+    } else {
+        arena->compact_from = offsetof_block(blck);
+    }
+    arena_leave(prev);
+    return done;
+}
+
+
+/**
+ * Let the heap profiler sample a new allocation.
+ * @param allocated The allocated storage or null.
+ * @param bytechunks The requested size.
+ * @param caller The return address of the heap call, where the sampled stack starts.
+ * @return Returns the allocated storage.
+ */
+
+static void *profile(void *allocated, size_t bytechunks, void *caller) {
+    if (allocated != NULL && mm_profile_enabled && mm_profile_sample(bytechunks)) {
+        ((HeadFoot *)allocated - 1)->k.sampled = 1;
+        mm_profile_record_alloc(allocated, bytechunks, caller);
+    }
+    return allocated;
+}
+
+
+/**
+ * Allocates the specified size and returns a pointer to the allocated storage
+ * if storage cannot be allocated sets errno and returns null.
+ * Blocks predicted to die young are placed in the short-lived arena.
+ * @param bytechunks The total amount of bytes which we need to allocate to our storage.
+ * @return Returns a pointer to the allocated memory if storage was available or returns null if allocation was not possible.
+ */
+
+void *mm_malloc(size_t bytechunks) {
+    if (!arenas_enabled()) {
+        return profile(allocate(bytechunks), bytechunks, __builtin_return_address(0));
+    }
+    Arena *a = local_arena();
+    uint32_t cls = 0;
+    if (lifetime_mode != MM_LIFETIME_OFF) {
+        cls = lifetimeclass(bytechunks, __builtin_return_address(0));
+        if (atomic_load_explicit(&lifetime_score[cls], memory_order_relaxed) > 0) {
+            a = &short_arena;
+        }
+    }
+    Arena *prev = arena_enter(a);
+    drain_remote_frees();
+    void *allocated = allocate(bytechunks);
+    if (allocated != NULL && cls != 0) {       //Stamp the block to learn its lifetime when freed.
+        size_t now = atomic_fetch_add_explicit(&lifetime_clock, bytechunks, memory_order_relaxed) + bytechunks;
+        ((HeadFoot *)allocated - 1)->k.next_free = ((now / LIFETIME_UNIT) & LIFETIME_STAMP_MASK) * LIFETIME_CLASSES + cls;
+        STAT(if (a == &short_arena) arena->stats.short_allocs++;)
+    }
+    arena_leave(prev);
+    return profile(allocated, bytechunks, __builtin_return_address(0));
 }
 
 
 /**
  * Reallocates the size of the memory which was already dynamically
  * allocated.Returns the pointer to the newly allocated storage or null if not possible.
+ * The storage stays in the arena that owns it.
  * @param allocatedptr The present storage which was allocated.
  * @param bytechunks The storage size which needs to be resized to this specified size.
  * @return
@@ -437,44 +2452,55 @@ void *mm_realloc(void *allocatedptr, size_t bytechunks) {
     if (allocatedptr == NULL) {      //If not already allocated.
         return mm_malloc(bytechunks);
     }
-    HeadFoot *blockv = allocatedblock(allocatedptr);  //Get the allocated block which is to be reallocated.
-    if (blockv == NULL) {            //If the required block is not available set errno.
-        errno = EFAULT;
-        return NULL;
-    }
-    size_t hchunks = headchunksize(bytechunks);
-    hchunks = hchunks + 2;
-    size_t insize = blockv->k.size_of_blk;
-    if (insize >= hchunks) {
-        return allocatedptr;
+    void *newloc;
+    if (!arenas_enabled()) {
+        newloc = reallocate(allocatedptr, bytechunks);
+    } else {
+        Arena *owner = owning_arena(allocatedptr);
+        if (owner == NULL) {
+            errno = EFAULT;
+            return NULL;
+        }
+        Arena *prev = arena_enter(owner);
+        newloc = reallocate(allocatedptr, bytechunks);
+        arena_leave(prev);
     }
-    HeadFoot *reblockptr = pick_free_block_from_list_first_fit(hchunks);  //Get a block based on first fit algorithm.
-    // HeadFoot *reblockptr = pick_free_block_from_list_best_fit(hchunks);     //Get a block based on best fit algorithm.
-    if (reblockptr == NULL) {
-        return NULL;
+    if (newloc == allocatedptr) {
+        return newloc;
     }
-    size_t copysize = insize - 2;
-    void *newloc =reblockptr + 1;  //The new payload is received.
-    size_t copybytes = conv_bytes(copysize); //Convert the header chunks to corresponding bytes.
-    memcpy(newloc, allocatedptr, copybytes); //copy to the new location.
-    returnfreeblocktolist(blockv); //return the old allocated storage to the free list.
-    return newloc;                 //return the new storage location.
+    return profile(newloc, bytechunks, __builtin_return_address(0));     //Moved storage is a new allocation.
 }
 
 
 /**
  * Frees the memory which the alloc pointer points to.
  * If memory was already freed it is an error and sets errno.
+ * The block is returned to the arena that owns it, through its remote
+ * free list if the calling thread does not allocate from that arena.
  * @param alloc The storage which was allocated to be freed.
  */
 
 void mm_free(void *alloc) {
-    if (alloc != NULL) {
-        HeadFoot *heaf = allocatedblock(alloc);  //Get the allocated block which is to be freed.
-        if (heaf == NULL) {             //If the required block is not available set errno.
-            errno = EFAULT;
-        } else {            //return the allocated block to the list of free blocks.
-            returnfreeblocktolist(heaf);
+    if (alloc == NULL) {
+        return;
+    }
+    if (!arenas_enabled()) {
+        deallocate(alloc);
+        return;
+    }
+    Arena *owner = owning_arena(alloc);
+    if (owner == NULL) {
+        errno = EFAULT;
+        return;
+    }
+    if (owner != local_arena() && owner != &main_arena && owner != &short_arena) {
+        if (!push_remote_free(owner, (HeadFoot *)alloc - 1)) {
+            errno = EFAULT;         //Not allocated, or already freed.
         }
+        return;
     }
+    Arena *prev = arena_enter(owner);
+    drain_remote_frees();
+    deallocate(alloc);
+    arena_leave(prev);
 }
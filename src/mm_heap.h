@@ -8,6 +8,75 @@
 #ifndef MM_HEAP_H_
 #define MM_HEAP_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Number of buckets in the free list probe histogram */
+#define MM_PROBE_BUCKETS 16
+
+/** Heap statistics, kept when the heap is compiled with MM_STATS */
+typedef struct {
+    size_t searches;                        /* mallocs that searched the free list */
+    size_t probes;                          /* free blocks visited by the searches */
+    size_t max_probes;                      /* most free blocks visited by one search */
+    size_t probe_hist[MM_PROBE_BUCKETS];    /* searches by probes: bucket i counts 2^i to 2^(i+1)-1, */
+                                            /* the last bucket everything above */
+    size_t fastbin_hits;                    /* mallocs served from a fast bin */
+    size_t splits;                          /* free blocks split to serve a request */
+    size_t coalesce_lower;                  /* frees merged with the block below only */
+    size_t coalesce_upper;                  /* frees merged with the block above only */
+    size_t coalesce_both;                   /* frees merged with the blocks below and above */
+    size_t growth_calls;                    /* times the heap was extended */
+    size_t growth_bytes;                    /* bytes the heap was extended by */
+    size_t growth_max;                      /* most bytes the heap was extended by at once */
+    size_t realloc_copies;                  /* reallocs that moved a block */
+    size_t realloc_copy_bytes;              /* bytes copied by those reallocs */
+    size_t compact_moves;                   /* movable blocks moved by compaction */
+    size_t compact_bytes;                   /* bytes moved by compaction */
+    size_t trim_calls;                      /* times compaction shrank the heap */
+    size_t trim_bytes;                      /* bytes the heap shrank by */
+    size_t short_allocs;                    /* mallocs placed in the short-lived heap */
+    size_t short_survivors;                 /* of those, blocks that lived long */
+    size_t missed_short;                    /* blocks in other heaps that died young */
+} MMStats;
+
+/** What mm_lifetime predicts block lifetimes from */
+typedef enum {
+    MM_LIFETIME_OFF,                        /* no prediction, one heap for all blocks */
+    MM_LIFETIME_SIZES,                      /* the size class of the request */
+    MM_LIFETIME_SITES                       /* the size class and the call site of mm_malloc */
+} MMLifetimeMode;
+
+/** Handle of a movable block, 0 for none */
+typedef uint32_t MMHandle;
+
+/** Magic number at the start of a heap snapshot */
+#define MM_SNAPSHOT_MAGIC "MMSNAP1"
+
+/** States of a block in a heap snapshot */
+typedef enum {
+    MM_BLOCK_FREE,                          /* on the free list */
+    MM_BLOCK_ALLOCATED,                     /* allocated */
+    MM_BLOCK_PARKED                         /* freed but parked in a fast bin */
+} MMBlockState;
+
+/** Header of a heap snapshot, followed by nblocks MMSnapshotBlock records */
+typedef struct {
+    char magic[8];                          /* MM_SNAPSHOT_MAGIC */
+    uint64_t tag;                           /* label given by the caller, e.g. an op index */
+    uint64_t heapsize;                      /* bytes in the heap */
+    uint64_t nblocks;                       /* number of blocks that follow */
+} MMSnapshotHeader;
+
+/** Block of a heap snapshot, in address order */
+typedef struct {
+    uint64_t offset;                        /* bytes from the start of the heap */
+    uint64_t size;                          /* bytes in the block, including its header */
+    uint32_t state;                         /* an MMBlockState */
+    int32_t freepos;                        /* position on the free list, or -1 if not free */
+} MMSnapshotBlock;
+
 /**
  * Initialize memory allocator
  */
@@ -58,5 +127,224 @@ void mm_free(void *ap);
  */
 void *mm_realloc(void *ap, size_t size);
 
+/**
+ * Get the number of bytes realloc has copied to move blocks.
+ *
+ * @return the bytes copied since the heap was last reset
+ */
+size_t mm_realloc_copied(void);
+
+/**
+ * Get the heap statistics since the heap was last reset.
+ *
+ * @param stats set to the statistics, or zeroed if not kept
+ * @return 1 if the heap keeps statistics, 0 if it was compiled without MM_STATS
+ */
+int mm_getstats(MMStats *stats);
+
+/**
+ * Write a snapshot of the heap layout: an MMSnapshotHeader followed by
+ * an MMSnapshotBlock for every block from the start of the heap, in
+ * host byte order. Snapshots can be appended to the same file.
+ *
+ * @param out the stream to write to
+ * @param tag the label to store in the snapshot
+ * @return the number of blocks written, or -1 if the write failed
+ */
+long mm_heap_snapshot(FILE *out, uint64_t tag);
+
+/**
+ * Place blocks by predicted lifetime: blocks predicted to die young
+ * get a heap of their own, so that long-lived blocks do not pin holes
+ * among them. Predictions are learned online from the blocks freed.
+ *
+ * @param mode what to predict lifetimes from, or MM_LIFETIME_OFF
+ * @return 1 if blocks are placed by lifetime, 0 if not
+ */
+int mm_lifetime(MMLifetimeMode mode);
+
+/**
+ * Get the bytes in all the heaps: the main heap and any node, thread
+ * or short-lived heaps.
+ *
+ * @return the total heap size
+ */
+size_t mm_heap_bytes(void);
+
+/**
+ * Write the heap to a file, to be mapped back by mm_restore.
+ *
+ * @param path the file to write
+ * @param root the storage from which the data in the heap is found, or NULL
+ * @return 0 if successful, -1 with errno set if not
+ */
+int mm_persist(const char *path, void *root);
+
+/**
+ * Replace the heap with one written by mm_persist. The file is mapped
+ * copy-on-write, so restoring takes time for the pages that are
+ * touched rather than for the blocks in the heap.
+ *
+ * @param path the file to map
+ * @param root set to the root storage given to mm_persist, if not NULL
+ * @return 0 if successful, -1 with errno set and the heap unchanged if not
+ */
+int mm_restore(const char *path, void **root);
+
+/**
+ * Allocate a movable block, reached through its handle so that
+ * mm_compact can move it while it is not locked.
+ *
+ * @param size the bytes required
+ * @return the handle, or 0 if not available
+ */
+MMHandle mm_halloc(size_t size);
+
+/**
+ * Lock a movable block in place. Locks nest.
+ *
+ * @param h the handle of the block
+ * @return the storage of the block, valid until the matching mm_hunlock,
+ *         or NULL with errno set if the handle is not in use
+ */
+void *mm_hlock(MMHandle h);
+
+/**
+ * Unlock a movable block locked by mm_hlock.
+ *
+ * @param h the handle of the block
+ */
+void mm_hunlock(MMHandle h);
+
+/**
+ * Free a movable block and its handle.
+ *
+ * @param h the handle of the block
+ */
+void mm_hfree(MMHandle h);
+
+/**
+ * Compact the heap: slide unlocked movable blocks down into the free
+ * space below them and give the free space left at the top of the heap
+ * back. A pass moves at most budget bytes and the next call resumes it,
+ * so compaction can be spread over idle periods.
+ *
+ * @param budget the most bytes to move, or 0 for no limit
+ * @return 1 if the pass finished and the heap was trimmed, 0 if it stopped on the budget
+ */
+int mm_compact(size_t budget);
+
+/** A heap in a region mapped from a file, memfd or shared memory object */
+typedef struct MMSharedHeap MMSharedHeap;
+
+/**
+ * Open a heap in a mapped region. Blocks are linked by offsets, so the
+ * heap can be mapped at any address: by several processes at once, or
+ * again after a restart. An empty file is sized and gets an empty heap;
+ * otherwise the heap already in the file is used as it is.
+ *
+ * @param fd the open file, readable and writable
+ * @param size the size of the mapping of an empty file
+ * @return the heap, or NULL if not available
+ */
+MMSharedHeap *mm_shared_open(int fd, size_t size);
+
+/**
+ * Unmap a shared heap. The heap stays in its file.
+ *
+ * @param h the heap
+ */
+void mm_shared_close(MMSharedHeap *h);
+
+/**
+ * Allocates nbytes from a shared heap.
+ *
+ * @param h the heap
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_shared_malloc(MMSharedHeap *h, size_t nbytes);
+
+/**
+ * Reallocates storage of a shared heap.
+ *
+ * @param h the heap
+ * @param ap the currently allocated storage, or NULL
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_shared_realloc(MMSharedHeap *h, void *ap, size_t nbytes);
+
+/**
+ * Frees storage of a shared heap.
+ *
+ * @param h the heap
+ * @param ap the allocated storage, or NULL
+ */
+void mm_shared_free(MMSharedHeap *h, void *ap);
+
+/**
+ * Get the offset of storage in a shared heap, which names it in every
+ * process that maps the heap.
+ *
+ * @param h the heap
+ * @param ap the storage, or NULL
+ * @return the offset, or 0 for NULL
+ */
+size_t mm_shared_offset(MMSharedHeap *h, const void *ap);
+
+/**
+ * Get the storage at an offset in a shared heap.
+ *
+ * @param h the heap
+ * @param offset the offset from mm_shared_offset
+ * @return the storage, or NULL for offset 0
+ */
+void *mm_shared_pointer(MMSharedHeap *h, size_t offset);
+
+/**
+ * Get the root storage of a shared heap, from which its users find
+ * their data after mapping it.
+ *
+ * @param h the heap
+ * @return the root storage, or NULL if none was set
+ */
+void *mm_shared_root(MMSharedHeap *h);
+
+/**
+ * Set the root storage of a shared heap.
+ *
+ * @param h the heap
+ * @param ap the new root storage, or NULL
+ */
+void mm_shared_set_root(MMSharedHeap *h, void *ap);
+
+/**
+ * Give every NUMA node its own arena whose memory is bound to the node.
+ * Threads then allocate from the arena of the node they run on, and
+ * blocks are freed back to the arena that owns them.
+ *
+ * @return the number of node arenas, or 0 if not available
+ */
+int mm_numa_init(void);
+
+/**
+ * Choose the node arena the calling thread allocates from.
+ *
+ * @param node the NUMA node, or -1 for the node the thread runs on
+ * @return the node of the chosen arena, or -1 if NUMA arenas are not enabled
+ */
+int mm_numa_bind(int node);
+
+/**
+ * Give the calling thread a private arena. Blocks freed by other
+ * threads are pushed onto the arena's lock-free remote free list
+ * and reclaimed in bulk the next time the owner allocates, frees,
+ * reads or resets the heap, or exits.
+ *
+ * @return the index of the thread arena, or -1 if none is available
+ */
+int mm_thread_arena(void);
+
 
 #endif /* MM_HEAP_H_ */
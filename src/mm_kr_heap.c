@@ -1,318 +1,746 @@
-///*
-// * mm_kr_heap.c
-// *
-// * Based on C dynamic memory manager code from
-// * Brian Kernighan and Dennis Richie (K&R)
-// *
-// *  @since Feb 13, 2019
-// *  @author philip gust
-// */
-//
-//
-//#include <stdio.h>
-//#include <unistd.h>
-//#include <stddef.h>
-//#include <string.h>
-//#include "memlib.h"
-//#include "mm_heap.h"
-//
-//
-///** Header information for allocated blocks */
-//typedef union header {          /* block header */
-//    struct {
-//        union header *ptr;      /* next block if on free list */
-//        size_t size;          	/* size of this block including header */
-//                                /* measured in multiple of header size */
-//    } s;
-//    max_align_t x;              /* force alignment to max align boundary */
-//} Header;
-//
-//// forward declarations
-//static Header *morecore(size_t);
-//void visualize(const char*);
-//
-///** total memory in chunks */
-//static size_t totmem = 0;
-//
-///** Empty list to get started */
-//static Header base;
-//
-///** Start of free memory list */
-//static Header *freep = NULL;
-//
-///**
-// * Initialize memory allocator
-// */
-//void mm_init() {
-//	mem_init();
-//
-//    base.s.ptr = freep = &base;
-//    base.s.size = 0;
-//
-//}
-//
-///**
-// * Reset memory allocator
-// */
-//void mm_reset() {
-//	mem_reset_brk();
-//
-//	base.s.ptr = freep = &base;
-//    base.s.size = 0;
-//}
-//
-///**
-// * De-initialize memory allocator
-// */
-//void mm_deinit() {
-//	mem_deinit();
-//
-//	base.s.ptr = freep = &base;
-//    base.s.size = 0;
-//}
-//
-///**
-// * Allocation units for nbytes.
-// *
-// * @param nbytes number of bytes
-// * @return number of units for nbytes
-// */
-//inline static size_t mm_units(size_t nbytes) {
-//    /* smallest count of Header-sized memory chunks */
-//    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
-//    return (nbytes + sizeof(Header) - 1) / sizeof(Header) + 1;
-//}
-//
-///**
-// * Allocation bytes for nunits.
-// *
-// * @param nunits number of units
-// * @return number of bytes for nunits
-// */
-//inline static size_t mm_bytes(size_t nunits) {
-//    return nunits * sizeof(Header);
-//}
-//
-///**
-// * Allocates size bytes of memory and returns a pointer to the
-// * allocated memory, or NULL if request storage cannot be allocated.
-// *
-// * @param nbytes the number of bytes to allocate
-// * @return pointer to allocated memory or NULL if not available.
-// */
-//void *mm_malloc(size_t nbytes) {
-//    if (freep == NULL) {
-//    	mm_init();
-//    }
-//
-//    Header *prevp = freep;
-//
-//    /* smallest count of Header-sized memory chunks */
-//    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
-//    size_t nunits = mm_units(nbytes);
-//
-//
-//    /* traverse the circular list to find a block */
-//    for (Header *p = prevp->s.ptr; ; prevp = p, p = p->s.ptr) {
-//        if (p->s.size >= nunits) {          /* big enough */
-//            if (p->s.size == nunits) {       /* exactly */
-//                prevp->s.ptr = p->s.ptr;
-//            } else {                         /* split allocate tail end */
-//                /* adjust the size to split the block */
-//                p->s.size -= nunits;
-//                /* find the address to return */
-//                p += p->s.size;
-//                p->s.size = nunits;
-//            }
-//            freep = prevp;  /* move the head */
-//            return (void *)(p+1);
-//        }
-//
-//        /* back where we started and nothing found - we need to allocate */
-//        if (p == freep) {                    /* wrapped around free list */
-//        	p = morecore(nunits);
-//        	if (p == NULL) {
-//                return NULL;                /* none left */
-//            }
-//        }
-//    }
-//}
-//
-//
-///**
-// * Deallocates the memory allocation pointed to by ptr.
-// * if ptr is a NULL pointer, no operation is performed.
-// *
-// * @param ap the allocated block to free
-// */
-//void mm_free(void *ap) {
-//    if (ap == NULL) {
-//        return;
-//    }
-//
-//    Header *bp = (Header *)ap - 1;                 /* point to block header */
-//
-//    if (bp->s.size == 0 || bp->s.size > totmem) {  /* cannot happen */
-//        return;
-//    }
-//
-//    /* look where to insert the free space */
-//
-//    /* (bp > p && bp < p->s.ptr)    => between two nodes */
-//    /* (p > p->s.ptr)               => this is the end of the list */
-//    /* (p == p->p.ptr)              => list is one element only */
-//    Header *p = freep;
-//    for ( ; !(bp > p && bp < p->s.ptr); p = p->s.ptr) {
-//        if (p >= p->s.ptr && (bp > p || bp < p->s.ptr)) {
-//       //     /* freed block at start or end of arena */
-//            break;
-//        }
-//	}
-//
-//    if (bp + bp->s.size == p->s.ptr) {      /* join to upper nbr */
-//    /* the new block fits perfect up to the upper neighbor */
-//
-//        /* merging up: adjust the size */
-//        bp->s.size += p->s.ptr->s.size;
-//        /* merging up: point to the second next */
-//        bp->s.ptr = p->s.ptr->s.ptr;
-//
-//    } else {
-//        /* set the upper pointer */
-//        bp->s.ptr = p->s.ptr;
-//    }
-//
-//    if (p + p->s.size == bp) {              /* join to lower nbr */
-//    /* the new block fits perfect on top of the lower neighbor */
-//
-//        /* merging below: adjust the size */
-//        p->s.size += bp->s.size;
-//        /* merging below: point to the next */
-//        p->s.ptr = bp->s.ptr;
-//
-//    } else {
-//        /* set the lower pointer */
-//        p->s.ptr = bp;
-//    }
-//
-//    /* reset the start of the free list */
-//    freep = p;
-//}
-//
-///**
-// * Reallocates size bytes of memory and returns a pointer to the
-// * allocated memory, or NULL if request storage cannot be allocated.
-// *
-// * @param ap the currently allocated storage
-// * @param nbytes the number of bytes to allocate
-// * @return pointer to allocated memory or NULL if not available.
-// */
-//void *mm_realloc(void *ap, size_t size) {
-//    Header *bp = (Header *)ap - 1;                 /* point to block header */
-//
-//    if (bp->s.size == 0 || bp->s.size > totmem) {
-//        return NULL;
-//    }
-//
-//    /* smallest count of Header-sized memory chunks */
-//    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
-//    size_t nunits = mm_units(size);
-//    if (bp->s.size >= nunits) {
-//    	return ap;
-//    }
-//    size_t oldsize = bp->s.size;  // save before malloc changes it
-//
-//    void *newap = mm_malloc(size);
-//    if (newap == NULL) {
-//    	return NULL;
-//    }
-//    // copy to new storage and free old storage
-//    size_t nbytes = mm_bytes(oldsize - 1);
-//    memcpy(newap, ap, nbytes);
-//    mm_free(ap);
-//
-//    return newap;
-//}
-//
-///**
-// * Request additional memory to be added to this process.
-// *
-// * @param nu the number of Header-chunks to be added
-// */
-//static Header *morecore(size_t nu) {
-//	// nalloc based on page size
-//	size_t nalloc = mem_pagesize()/sizeof(Header);
-//    /* get at least NALLOC Header-chunks from the OS */
-//    if (nu < nalloc) {
-//        nu = nalloc;
-//    }
-//
-//    size_t nbytes = mm_bytes(nu); // number of bytes
-//    char *cp = (char *) mem_sbrk(nbytes);
-//    if (cp == (char *) -1) {                 /* no space at all */
-//        return NULL;
-//    }
-//    totmem += nu;                           /* keep track of allocated memory */
-//
-//    Header *up = (Header *) cp;
-//    up->s.size = nu;
-//
-//    /* add the free space to the circular list */
-//    void *n = (void *)(up+1);
-//    mm_free(n);
-//
-//    return freep;
-//}
-//
-///**
-// * Print the free list (educational purpose) *
-// *
-// * @msg the initial message to print
-// */
-//void visualize(const char* msg) {
-//    Header *tmp;
-//
-//    fprintf(stderr, "\n--- Free list after \"%s\":\n", msg);
-//
-//    if (freep == NULL) {                   /* does not exist */
-//        fprintf(stderr, "    List does not exist\n\n");
-//        return;
-//    }
-//
-//    if (freep == freep->s.ptr) {          /* self-pointing list = empty */
-//        fprintf(stderr, "    List is empty\n\n");
-//        return;
-//    }
-//
-//    tmp = freep;                           /* find the start of the list */
-//    char *str = "    ";
-//    do {           /* traverse the list */
-//        fprintf(stderr, "%sptr: %10p size: %-3lu\n", str, (void *)tmp, tmp->s.size);
-//        str = " -> ";
-//        tmp = tmp->s.ptr;
-//    }  while (tmp->s.ptr > freep);
-//
-//    fprintf(stderr, "--- end\n\n");
-//}
-//
-//
-///**
-// * Calculate the total amount of available free memory.
-// *
-// * @return the amount of free memory in bytes
-// */
-//size_t mm_getfree(void) {
-//    if (freep == NULL) {
-//        return 0;
-//    }
-//
-//    Header *tmp = freep;
-//    size_t res = tmp->s.size;
-//
-//    while (tmp->s.ptr > tmp) {
-//        tmp = tmp->s.ptr;
-//        res += tmp->s.size;
-//    }
-//
-//    return mm_bytes(res);
-//}
+/*
+ * mm_kr_heap.c
+ *
+ * Based on C dynamic memory manager code from
+ * Brian Kernighan and Dennis Richie (K&R)
+ *
+ * Free blocks are kept in a treap ordered by address instead of the
+ * K&R circular list, so freeing a block finds its neighbors and
+ * coalesces in O(log n) rather than walking the list. Each node also
+ * records the largest block size in its subtree, which lets mm_malloc
+ * find the lowest-addressed block that fits in O(log n). A node's
+ * priority is a hash of its address, so a free block needs just its
+ * one-word header plus two words of tree links in its payload.
+ *
+ * Build with this file in place of mm_dlink_heap.c.
+ *
+ *  @since Feb 13, 2019
+ *  @author philip gust
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include "memlib.h"
+#include "mm_heap.h"
+#include "mm_profile.h"
+
+
+/** Header information for allocated blocks */
+typedef union header {          /* block header */
+    struct {
+        union header *ptr;      /* left child (lower addresses) if on free tree, */
+                                /* itself if allocated and sampled by the profiler */
+        size_t size;          	/* size of this block including header */
+                                /* measured in multiple of header size */
+    } s;
+    max_align_t x;              /* force alignment to max align boundary */
+} Header;
+
+/** Tree links kept in the payload of a free block */
+typedef struct {
+    Header *right;              /* right child (higher addresses) */
+    size_t maxsize;             /* largest block size in this subtree */
+} Links;
+
+/** smallest block: header plus room for the tree links */
+#define MIN_UNITS (1 + (sizeof(Links) + sizeof(Header) - 1) / sizeof(Header))
+
+// forward declarations
+static Header *morecore(size_t);
+void visualize(const char*);
+
+/** total memory in chunks */
+static size_t totmem = 0;
+
+/** free memory in chunks */
+static size_t freemem = 0;
+
+/** bytes copied by realloc */
+static size_t realloc_copied = 0;
+
+/** Root of the free tree */
+static Header *root = NULL;
+
+/** true once initialized */
+static int initialized = 0;
+
+/**
+ * Left child of a free block.
+ */
+static inline Header **left(Header *p) {
+    return &p->s.ptr;
+}
+
+/**
+ * Right child of a free block.
+ */
+static inline Header **right(Header *p) {
+    return &((Links *)(p + 1))->right;
+}
+
+/**
+ * Largest block size in the subtree of a free block.
+ */
+static inline size_t maxsize(Header *p) {
+    return (p == NULL) ? 0 : ((Links *)(p + 1))->maxsize;
+}
+
+/**
+ * Treap priority of a free block, a hash of its address.
+ */
+static inline uint64_t priority(Header *p) {
+    return (uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ULL;
+}
+
+/**
+ * Recompute the largest block size in the subtree of a free block.
+ */
+static inline void update(Header *p) {
+    size_t m = p->s.size;
+    if (maxsize(*left(p)) > m) {
+        m = maxsize(*left(p));
+    }
+    if (maxsize(*right(p)) > m) {
+        m = maxsize(*right(p));
+    }
+    ((Links *)(p + 1))->maxsize = m;
+}
+
+/**
+ * Merge two treaps where every block of a is below every block of b.
+ *
+ * @return the root of the merged treap
+ */
+static Header *merge(Header *a, Header *b) {
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (priority(a) > priority(b)) {
+        *right(a) = merge(*right(a), b);
+        update(a);
+        return a;
+    }
+    *left(b) = merge(a, *left(b));
+    update(b);
+    return b;
+}
+
+/**
+ * Split a treap into the blocks below bp and the blocks at or above bp.
+ */
+static void split(Header *t, Header *bp, Header **lo, Header **hi) {
+    if (t == NULL) {
+        *lo = *hi = NULL;
+    } else if (t < bp) {
+        split(*right(t), bp, right(t), hi);
+        update(t);
+        *lo = t;
+    } else {
+        split(*left(t), bp, lo, left(t));
+        update(t);
+        *hi = t;
+    }
+}
+
+/**
+ * Remove the highest-addressed block of a treap.
+ *
+ * @param t the treap
+ * @param maxp set to the removed block
+ * @return the root of the remaining treap
+ */
+static Header *remove_max(Header *t, Header **maxp) {
+    if (*right(t) == NULL) {
+        *maxp = t;
+        return *left(t);
+    }
+    *right(t) = remove_max(*right(t), maxp);
+    update(t);
+    return t;
+}
+
+/**
+ * Remove the lowest-addressed block of a treap.
+ *
+ * @param t the treap
+ * @param minp set to the removed block
+ * @return the root of the remaining treap
+ */
+static Header *remove_min(Header *t, Header **minp) {
+    if (*left(t) == NULL) {
+        *minp = t;
+        return *right(t);
+    }
+    *left(t) = remove_min(*left(t), minp);
+    update(t);
+    return t;
+}
+
+/**
+ * Find the lowest-addressed free block with at least nunits.
+ *
+ * @return the block, or NULL if none fits
+ */
+static Header *first_fit(size_t nunits) {
+    Header *p = root;
+    if (maxsize(p) < nunits) {
+        return NULL;
+    }
+    for (;;) {
+        if (maxsize(*left(p)) >= nunits) {
+            p = *left(p);
+        } else if (p->s.size >= nunits) {
+            return p;
+        } else {
+            p = *right(p);
+        }
+    }
+}
+
+/**
+ * Take nunits from the free block bp, removing it from the tree if it
+ * fits exactly or else shrinking it and allocating its tail end.
+ *
+ * @param t the subtree holding bp
+ * @return the root of the subtree
+ */
+static Header *take(Header *t, Header *bp, size_t nunits, Header **allocp) {
+    if (bp < t) {
+        *left(t) = take(*left(t), bp, nunits, allocp);
+    } else if (bp > t) {
+        *right(t) = take(*right(t), bp, nunits, allocp);
+    } else if (t->s.size - nunits < MIN_UNITS) {      /* exactly, or no room to split */
+        *allocp = t;
+        return merge(*left(t), *right(t));
+    } else {                                        /* split allocate tail end */
+        t->s.size -= nunits;
+        *allocp = t + t->s.size;
+        (*allocp)->s.size = nunits;
+    }
+    update(t);
+    return t;
+}
+
+/**
+ * Initialize memory allocator
+ */
+void mm_init() {
+	mem_init();
+
+    root = NULL;
+    totmem = freemem = 0;
+    initialized = 1;
+}
+
+/**
+ * Reset memory allocator
+ */
+void mm_reset() {
+	mem_reset_brk();
+
+    root = NULL;
+    totmem = freemem = 0;
+    realloc_copied = 0;
+    mm_profile_reset();
+}
+
+/**
+ * De-initialize memory allocator
+ */
+void mm_deinit() {
+	mem_deinit();
+
+    root = NULL;
+    totmem = freemem = 0;
+    initialized = 0;
+}
+
+/**
+ * Allocation units for nbytes.
+ *
+ * @param nbytes number of bytes
+ * @return number of units for nbytes, too many for any heap if nbytes
+ *    is too large to sbrk
+ */
+inline static size_t mm_units(size_t nbytes) {
+    if (nbytes > PTRDIFF_MAX - sizeof(Header)) {
+        return PTRDIFF_MAX / sizeof(Header);    /* rather than wrap around */
+    }
+    /* smallest count of Header-sized memory chunks */
+    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
+    size_t nunits = (nbytes + sizeof(Header) - 1) / sizeof(Header) + 1;
+    return (nunits < MIN_UNITS) ? MIN_UNITS : nunits;  /* room for tree links once freed */
+}
+
+/**
+ * Allocation bytes for nunits.
+ *
+ * @param nunits number of units
+ * @return number of bytes for nunits
+ */
+inline static size_t mm_bytes(size_t nunits) {
+    return nunits * sizeof(Header);
+}
+
+/**
+ * Allocates nbytes of memory from the free tree, without letting the
+ * heap profiler sample it.
+ *
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+static void *allocate(size_t nbytes) {
+    if (!initialized) {
+    	mm_init();
+    }
+
+    /* smallest count of Header-sized memory chunks */
+    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
+    size_t nunits = mm_units(nbytes);
+
+    /* lowest-addressed block that is big enough */
+    Header *p = first_fit(nunits);
+    if (p == NULL) {
+        if (morecore(nunits) == NULL) {
+            errno = ENOMEM;
+            return NULL;                /* none left */
+        }
+        p = first_fit(nunits);
+    }
+
+    Header *ap;
+    root = take(root, p, nunits, &ap);
+    freemem -= ap->s.size;
+    ap->s.ptr = NULL;                           /* not sampled */
+    return (void *)(ap+1);
+}
+
+/**
+ * Let the heap profiler sample a new allocation, marking its block.
+ *
+ * @param ap the allocated storage, or NULL
+ * @param nbytes the requested size
+ * @param caller the return address of the heap call
+ * @return the allocated storage
+ */
+static void *profile(void *ap, size_t nbytes, void *caller) {
+    if (ap != NULL && mm_profile_enabled && mm_profile_sample(nbytes)) {
+        Header *bp = (Header *)ap - 1;
+        bp->s.ptr = bp;
+        mm_profile_record_alloc(ap, nbytes, caller);
+    }
+    return ap;
+}
+
+/**
+ * Allocates size bytes of memory and returns a pointer to the
+ * allocated memory, or NULL if request storage cannot be allocated.
+ *
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_malloc(size_t nbytes) {
+    return profile(allocate(nbytes), nbytes, __builtin_return_address(0));
+}
+
+
+/**
+ * Deallocates the memory allocation pointed to by ptr.
+ * if ptr is a NULL pointer, no operation is performed.
+ *
+ * @param ap the allocated block to free
+ */
+void mm_free(void *ap) {
+    if (ap == NULL) {
+        return;
+    }
+
+    Header *bp = (Header *)ap - 1;                 /* point to block header */
+
+    if (bp->s.size == 0 || bp->s.size > totmem) {  /* cannot happen */
+        return;
+    }
+    if (bp->s.ptr == bp) {                         /* sampled allocation */
+        mm_profile_record_free(ap);
+    }
+    freemem += bp->s.size;
+
+    /* split the tree at the freed block to find its neighbors */
+    Header *lo, *hi;
+    split(root, bp, &lo, &hi);
+
+    Header *p = lo;
+    while (p != NULL && *right(p) != NULL) {     /* highest block below */
+        p = *right(p);
+    }
+    if (p != NULL && p + p->s.size == bp) {      /* join to lower nbr */
+        lo = remove_max(lo, &p);
+        p->s.size += bp->s.size;
+        bp = p;
+    }
+
+    p = hi;
+    while (p != NULL && *left(p) != NULL) {      /* lowest block above */
+        p = *left(p);
+    }
+    if (p != NULL && bp + bp->s.size == p) {     /* join to upper nbr */
+        hi = remove_min(hi, &p);
+        bp->s.size += p->s.size;
+    }
+
+    *left(bp) = *right(bp) = NULL;
+    update(bp);
+    root = merge(merge(lo, bp), hi);
+}
+
+/**
+ * Reallocates size bytes of memory and returns a pointer to the
+ * allocated memory, or NULL if request storage cannot be allocated.
+ *
+ * @param ap the currently allocated storage
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_realloc(void *ap, size_t size) {
+    if (ap == NULL) {
+        return mm_malloc(size);
+    }
+    Header *bp = (Header *)ap - 1;                 /* point to block header */
+
+    if (bp->s.size == 0 || bp->s.size > totmem) {
+        errno = EFAULT;
+        return NULL;
+    }
+
+    /* smallest count of Header-sized memory chunks */
+    /*  (+1 additional chunk for the Header itself) needed to hold nbytes */
+    size_t nunits = mm_units(size);
+    if (bp->s.size >= nunits) {
+    	return ap;
+    }
+    size_t oldsize = bp->s.size;  // save before malloc changes it
+
+    void *newap = allocate(size);
+    if (newap == NULL) {
+    	return NULL;
+    }
+    // copy to new storage and free old storage
+    size_t nbytes = mm_bytes(oldsize - 1);
+    memcpy(newap, ap, nbytes);
+    realloc_copied += nbytes;
+    mm_free(ap);
+
+    return profile(newap, size, __builtin_return_address(0));     /* moved storage is a new allocation */
+}
+
+/**
+ * Request additional memory to be added to this process.
+ *
+ * @param nu the number of Header-chunks to be added
+ */
+static Header *morecore(size_t nu) {
+	// nalloc based on page size
+	size_t nalloc = mem_pagesize()/sizeof(Header);
+    /* get at least NALLOC Header-chunks from the OS */
+    if (nu < nalloc) {
+        nu = nalloc;
+    }
+
+    size_t nbytes = mm_bytes(nu); // number of bytes
+    char *cp = (char *) mem_sbrk(nbytes);
+    if (cp == (char *) -1) {                 /* no space at all */
+        return NULL;
+    }
+    totmem += nu;                           /* keep track of allocated memory */
+
+    Header *up = (Header *) cp;
+    up->s.size = nu;
+    up->s.ptr = NULL;                       /* not a sampled allocation */
+
+    /* add the free space to the tree, joining the block below */
+    void *n = (void *)(up+1);
+    mm_free(n);
+
+    return root;
+}
+
+/**
+ * Print a subtree of the free tree in address order.
+ */
+static void visualize_tree(Header *p, char **str) {
+    if (p == NULL) {
+        return;
+    }
+    visualize_tree(*left(p), str);
+    fprintf(stderr, "%sptr: %10p size: %-3lu\n", *str, (void *)p, p->s.size);
+    *str = " -> ";
+    visualize_tree(*right(p), str);
+}
+
+/**
+ * Print the free list (educational purpose) *
+ *
+ * @msg the initial message to print
+ */
+void visualize(const char* msg) {
+    fprintf(stderr, "\n--- Free list after \"%s\":\n", msg);
+
+    if (!initialized) {                    /* does not exist */
+        fprintf(stderr, "    List does not exist\n\n");
+        return;
+    }
+
+    if (root == NULL) {                    /* empty */
+        fprintf(stderr, "    List is empty\n\n");
+        return;
+    }
+
+    char *str = "    ";
+    visualize_tree(root, &str);
+
+    fprintf(stderr, "--- end\n\n");
+}
+
+
+/**
+ * Calculate the total amount of available free memory.
+ *
+ * @return the amount of free memory in bytes
+ */
+size_t mm_getfree(void) {
+    return mm_bytes(freemem);
+}
+
+/**
+ * Get the number of bytes realloc has copied to move blocks.
+ *
+ * @return the bytes copied since the heap was last reset
+ */
+size_t mm_realloc_copied(void) {
+    return realloc_copied;
+}
+
+/**
+ * Collect the free blocks of a subtree in address order.
+ */
+static void collect_free(Header *p, Header **blocks, size_t *n) {
+    if (p == NULL) {
+        return;
+    }
+    collect_free(*left(p), blocks, n);
+    blocks[(*n)++] = p;
+    collect_free(*right(p), blocks, n);
+}
+
+/**
+ * Write a snapshot of the heap layout. The free tree has no list
+ * order, so a free block's position is its rank by address.
+ *
+ * @param out the stream to write to
+ * @param tag the label to store in the snapshot
+ * @return the number of blocks written, or -1 if the write failed
+ */
+long mm_heap_snapshot(FILE *out, uint64_t tag) {
+    MMSnapshotHeader header = { MM_SNAPSHOT_MAGIC, tag, mem_heapsize(), 0 };
+    Header *lo = mem_heap_lo();
+    Header *hi = (Header *)((char *)lo + (initialized ? mem_heapsize() : 0));
+    for (Header *p = lo; p < hi; p += p->s.size) {
+        header.nblocks++;
+    }
+
+    size_t nfree = 0;
+    Header **blocks = malloc((mm_bytes(totmem) / mm_bytes(MIN_UNITS) + 1) * sizeof(Header *));
+    if (blocks == NULL) {
+        return -1;
+    }
+    collect_free(root, blocks, &nfree);
+
+    long written = -1;
+    if (fwrite(&header, sizeof(header), 1, out) == 1) {
+        written = 0;
+        size_t f = 0;
+        for (Header *p = lo; p < hi; p += p->s.size) {
+            MMSnapshotBlock block = { (char *)p - (char *)lo, mm_bytes(p->s.size), MM_BLOCK_ALLOCATED, -1 };
+            if (f < nfree && blocks[f] == p) {
+                block.state = MM_BLOCK_FREE;
+                block.freepos = (int32_t)f++;
+            }
+            if (fwrite(&block, sizeof(block), 1, out) != 1) {
+                written = -1;
+                break;
+            }
+            written++;
+        }
+    }
+    free(blocks);
+    return written;
+}
+
+/**
+ * Shared heaps are not supported by this heap, whose free tree
+ * links are pointers.
+ *
+ * @return NULL
+ */
+MMSharedHeap *mm_shared_open(int fd, size_t size) {
+    (void)fd; (void)size;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+void mm_shared_close(MMSharedHeap *h) {
+    (void)h;
+}
+
+void *mm_shared_malloc(MMSharedHeap *h, size_t nbytes) {
+    (void)h; (void)nbytes;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+void *mm_shared_realloc(MMSharedHeap *h, void *ap, size_t nbytes) {
+    (void)h; (void)ap; (void)nbytes;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+void mm_shared_free(MMSharedHeap *h, void *ap) {
+    (void)h; (void)ap;
+}
+
+size_t mm_shared_offset(MMSharedHeap *h, const void *ap) {
+    (void)h; (void)ap;
+    return 0;
+}
+
+void *mm_shared_pointer(MMSharedHeap *h, size_t offset) {
+    (void)h; (void)offset;
+    return NULL;
+}
+
+void *mm_shared_root(MMSharedHeap *h) {
+    (void)h;
+    return NULL;
+}
+
+void mm_shared_set_root(MMSharedHeap *h, void *ap) {
+    (void)h; (void)ap;
+}
+
+/**
+ * Persisted heaps are not supported by this heap, whose free tree
+ * links would not survive mapping the heap at another address.
+ *
+ * @return -1
+ */
+int mm_persist(const char *path, void *root) {
+    (void)path; (void)root;
+    errno = ENOTSUP;
+    return -1;
+}
+
+int mm_restore(const char *path, void **root) {
+    (void)path; (void)root;
+    errno = ENOTSUP;
+    return -1;
+}
+
+/**
+ * Movable blocks are not supported by this heap. mm_halloc never
+ * gives out a handle, so mm_hunlock and mm_hfree have nothing to do,
+ * and mm_compact has nothing to move, so it reports a finished pass.
+ *
+ * @return 0 or NULL with errno set to ENOTSUP; 1 from mm_compact
+ */
+MMHandle mm_halloc(size_t nbytes) {
+    (void)nbytes;
+    errno = ENOTSUP;
+    return 0;
+}
+
+void *mm_hlock(MMHandle h) {
+    (void)h;
+    errno = ENOTSUP;
+    return NULL;
+}
+
+void mm_hunlock(MMHandle h) {
+    (void)h;
+}
+
+void mm_hfree(MMHandle h) {
+    (void)h;
+}
+
+int mm_compact(size_t budget) {
+    (void)budget;
+    return 1;
+}
+
+/**
+ * Lifetime placement is not supported by this heap.
+ *
+ * @return 0 with errno set to ENOTSUP
+ */
+int mm_lifetime(MMLifetimeMode mode) {
+    (void)mode;
+    errno = ENOTSUP;
+    return 0;
+}
+
+/**
+ * This heap has only the one heap.
+ *
+ * @return the heap size
+ */
+size_t mm_heap_bytes() {
+    return mem_heapsize();
+}
+
+/**
+ * Statistics are not kept by this heap.
+ *
+ * @param stats zeroed
+ * @return 0
+ */
+int mm_getstats(MMStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+/**
+ * NUMA arenas are not supported by this heap.
+ *
+ * @return 0
+ */
+int mm_numa_init(void) {
+    return 0;
+}
+
+/**
+ * NUMA arenas are not supported by this heap.
+ *
+ * @return -1
+ */
+int mm_numa_bind(int node) {
+    (void)node;
+    return -1;
+}
+
+/**
+ * Thread arenas are not supported by this heap.
+ *
+ * @return -1
+ */
+int mm_thread_arena(void) {
+    return -1;
+}
@@ -0,0 +1,160 @@
+/*
+ * mm_pool.c - pools of fixed-size objects.
+ *
+ * Free slots are linked through their first word in a LIFO list. A new
+ * slab is carved up lazily, one slot at a time, so its pages are only
+ * touched as they are used. Slabs are returned to the heap when the
+ * pool is destroyed.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "memlib.h"
+#include "mm_heap.h"
+#include "mm_pool.h"
+
+/** Minimum number of slots in a slab */
+#ifndef POOL_MIN_SLOTS
+#define POOL_MIN_SLOTS 8
+#endif
+
+/** Header of a slab */
+typedef struct Slab {
+	struct Slab *next;          /* next slab of the pool */
+} Slab;
+
+/** A free slot */
+typedef struct Slot {
+	struct Slot *next;          /* next free slot */
+} Slot;
+
+/** A pool */
+struct MMPool {
+	Slot *free;                 /* free slots, most recently freed first */
+	char *next;                 /* next unused slot of the newest slab */
+	char *limit;                /* end of the newest slab */
+	Slab *slabs;                /* slabs of the pool */
+	size_t slot_size;           /* bytes per slot */
+	size_t align;               /* alignment of a slot */
+	size_t slab_size;           /* bytes per slab */
+};
+
+/** Round n up to a multiple of the power of 2 a */
+#define ROUND_UP(n, a) (((n) + (a) - 1) & ~((a) - 1))
+
+/**
+ * Create a pool of objects.
+ *
+ * @param obj_size the size of an object in bytes
+ * @param align the alignment of an object, a power of 2, or 0 for
+ *   the alignment of any type
+ * @return the pool, or NULL if not available or align is invalid
+ */
+MMPool *mm_pool_create(size_t obj_size, size_t align) {
+	if (align == 0) {
+		align = _Alignof(max_align_t);
+	}
+	if ((align & (align - 1)) != 0 || obj_size > SIZE_MAX / 2 || align > SIZE_MAX / 4) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (align < _Alignof(Slot)) {
+		align = _Alignof(Slot);             /* room to link a free slot */
+	}
+	if (obj_size < sizeof(Slot)) {
+		obj_size = sizeof(Slot);
+	}
+
+	MMPool *pool = mm_malloc(sizeof(MMPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	pool->free = NULL;
+	pool->next = pool->limit = NULL;
+	pool->slabs = NULL;
+	pool->align = align;
+	pool->slot_size = ROUND_UP(obj_size, align);
+
+	/* whole pages with room for the slab header, alignment, and the slots */
+	size_t page = mem_pagesize();
+	size_t need = sizeof(Slab) + align - 1 + POOL_MIN_SLOTS * pool->slot_size;
+	pool->slab_size = (need + page - 1) / page * page;
+	return pool;
+}
+
+/**
+ * Add a slab to a pool.
+ *
+ * @param pool the pool
+ * @return 1 if a slab was added, 0 if not available
+ */
+static int add_slab(MMPool *pool) {
+	Slab *slab = mm_malloc(pool->slab_size);
+	if (slab == NULL) {
+		return 0;
+	}
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	uintptr_t first = ROUND_UP((uintptr_t)(slab + 1), pool->align);
+	pool->next = (char*)first;
+	pool->limit = (char*)slab + pool->slab_size;
+	return 1;
+}
+
+/**
+ * Allocates an object from a pool.
+ *
+ * @param pool the pool
+ * @return pointer to the object or NULL if not available.
+ */
+void *mm_pool_alloc(MMPool *pool) {
+	Slot *slot = pool->free;
+	if (slot != NULL) {
+		pool->free = slot->next;
+		return slot;
+	}
+	if ((size_t)(pool->limit - pool->next) < pool->slot_size) {
+		if (!add_slab(pool)) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	void *p = pool->next;
+	pool->next += pool->slot_size;
+	return p;
+}
+
+/**
+ * Returns an object to the pool it was allocated from.
+ * if ptr is a NULL pointer, no operation is performed.
+ *
+ * @param pool the pool
+ * @param ptr the object to free
+ */
+void mm_pool_free(MMPool *pool, void *ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+	Slot *slot = ptr;
+	slot->next = pool->free;
+	pool->free = slot;
+}
+
+/**
+ * Free a pool and every object allocated from it.
+ *
+ * @param pool the pool
+ */
+void mm_pool_destroy(MMPool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+	while (pool->slabs != NULL) {
+		Slab *slab = pool->slabs;
+		pool->slabs = slab->next;
+		mm_free(slab);
+	}
+	mm_free(pool);
+}
@@ -0,0 +1,51 @@
+/*
+ * mm_pool.h - pools of fixed-size objects.
+ *
+ * A pool hands out slots of one size from page-sized slabs taken from
+ * the heap with mm_malloc. Slots carry no header, and a freed slot is
+ * the next one handed out, so a hot object tends to stay in cache.
+ */
+
+#ifndef MM_POOL_H_
+#define MM_POOL_H_
+
+#include <stddef.h>
+
+/** A pool */
+typedef struct MMPool MMPool;
+
+/**
+ * Create a pool of objects.
+ *
+ * @param obj_size the size of an object in bytes
+ * @param align the alignment of an object, a power of 2, or 0 for
+ *   the alignment of any type
+ * @return the pool, or NULL if not available or align is invalid
+ */
+MMPool *mm_pool_create(size_t obj_size, size_t align);
+
+/**
+ * Allocates an object from a pool.
+ *
+ * @param pool the pool
+ * @return pointer to the object or NULL if not available.
+ */
+void *mm_pool_alloc(MMPool *pool);
+
+/**
+ * Returns an object to the pool it was allocated from.
+ * if ptr is a NULL pointer, no operation is performed.
+ *
+ * @param pool the pool
+ * @param ptr the object to free
+ */
+void mm_pool_free(MMPool *pool, void *ptr);
+
+/**
+ * Free a pool and every object allocated from it.
+ *
+ * @param pool the pool
+ */
+void mm_pool_destroy(MMPool *pool);
+
+#endif /* MM_POOL_H_ */
@@ -0,0 +1,344 @@
+/*
+ * mm_profile.c - sampling heap profiler.
+ *
+ * Samples are kept in two chained hash tables allocated from the system
+ * heap: the call stacks with their live and allocated totals, and the
+ * live samples keyed by address. The heap marks sampled blocks so that
+ * only their frees look up the live-sample table.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <execinfo.h>
+
+#include "mm_profile.h"
+
+/** Maximum number of frames in a sampled call stack */
+#define MAX_DEPTH 32
+
+/** Frames of the heap and the profiler captured above a sampled call stack */
+#define HEAP_DEPTH 4
+
+/** Number of buckets in the call stack and live-sample tables */
+#define STACK_BUCKETS (1<<12)
+#define SAMPLE_BUCKETS (1<<14)
+
+/** A distinct call stack and its totals */
+typedef struct Stack {
+	struct Stack *next;         /* next stack in the bucket */
+	uint64_t hash;              /* hash of the frames */
+	int depth;                  /* number of frames */
+	void *frames[MAX_DEPTH];    /* return addresses, innermost first */
+	size_t live_count;          /* live samples */
+	size_t live_bytes;          /* bytes of the live samples */
+	size_t alloc_count;         /* samples taken */
+	size_t alloc_bytes;         /* bytes of the samples taken */
+} Stack;
+
+/** A live sampled allocation */
+typedef struct Sample {
+	struct Sample *next;        /* next sample in the bucket */
+	void *ptr;                  /* the allocated storage */
+	size_t size;                /* the requested size */
+	Stack *stack;               /* where it was allocated */
+} Sample;
+
+bool mm_profile_enabled = false;
+__thread size_t mm_profile_countdown = 0;
+
+/** mean bytes between samples */
+static size_t profile_interval = 512*1024;
+
+/** random state of the calling thread */
+static __thread uint64_t profile_random = 0;
+
+/** guards the tables */
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Stack *stacks[STACK_BUCKETS];
+static Sample *samples[SAMPLE_BUCKETS];
+static Sample *free_samples = NULL;     /* recycled sample records */
+
+/**
+ * Draw the number of bytes until the next sample from an exponential
+ * distribution with mean profile_interval.
+ *
+ * @return bytes until the next sample
+ */
+static size_t next_countdown(void) {
+	if (profile_random == 0) {
+		profile_random = (uint64_t)(uintptr_t)&profile_random ^ (uint64_t)time(NULL) ^ 0x9E3779B97F4A7C15ULL;
+	}
+	/* xorshift64 */
+	profile_random ^= profile_random << 13;
+	profile_random ^= profile_random >> 7;
+	profile_random ^= profile_random << 17;
+	double u = ((profile_random >> 11) + 1) * (1.0 / 9007199254740993.0);  /* (0,1] */
+	return (size_t)(-log(u) * profile_interval) + 1;
+}
+
+/**
+ * Hash a pointer to a bucket of the live-sample table.
+ */
+static size_t sample_bucket(const void *ptr) {
+	uint64_t h = (uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ULL;
+	return (size_t)(h >> 40) & (SAMPLE_BUCKETS - 1);
+}
+
+/**
+ * Find or add the entry for a call stack. Called with profile_lock held.
+ *
+ * @param frames the return addresses
+ * @param depth the number of frames
+ * @return the stack entry, or NULL if out of memory
+ */
+static Stack *find_stack(void *frames[], int depth) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < depth; i++) {
+		hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ULL;
+	}
+	Stack **bucket = &stacks[hash & (STACK_BUCKETS - 1)];
+	for (Stack *s = *bucket; s != NULL; s = s->next) {
+		if (s->hash == hash && s->depth == depth
+			&& memcmp(s->frames, frames, depth * sizeof(void *)) == 0) {
+			return s;
+		}
+	}
+	Stack *s = calloc(1, sizeof(Stack));
+	if (s == NULL) {
+		return NULL;
+	}
+	s->hash = hash;
+	s->depth = depth;
+	memcpy(s->frames, frames, depth * sizeof(void *));
+	s->next = *bucket;
+	*bucket = s;
+	return s;
+}
+
+/**
+ * Remove the live sample for an address. Called with profile_lock held.
+ *
+ * @param ptr the address
+ */
+static void remove_sample(void *ptr) {
+	for (Sample **link = &samples[sample_bucket(ptr)]; *link != NULL; link = &(*link)->next) {
+		Sample *sample = *link;
+		if (sample->ptr == ptr) {
+			sample->stack->live_count--;
+			sample->stack->live_bytes -= sample->size;
+			*link = sample->next;
+			sample->next = free_samples;
+			free_samples = sample;
+			return;
+		}
+	}
+}
+
+/**
+ * Start sampling allocations.
+ *
+ * @param interval the mean number of bytes allocated between samples
+ */
+void mm_profile_start(size_t interval) {
+	void *frames[1];
+	backtrace(frames, 1);   /* loads the unwinder before the first sample */
+	profile_interval = (interval == 0) ? 1 : interval;
+	mm_profile_countdown = next_countdown();
+	mm_profile_enabled = true;
+}
+
+/**
+ * Stop sampling allocations. Samples taken so far are kept.
+ */
+void mm_profile_stop(void) {
+	mm_profile_enabled = false;
+}
+
+/**
+ * Forget the live samples, e.g. because the heap was reset.
+ */
+void mm_profile_reset(void) {
+	pthread_mutex_lock(&profile_lock);
+	for (size_t b = 0; b < SAMPLE_BUCKETS; b++) {
+		while (samples[b] != NULL) {
+			remove_sample(samples[b]->ptr);
+		}
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Record a sampled allocation with the call stack of the caller.
+ *
+ * @param ptr the allocated storage
+ * @param size the requested size
+ */
+void mm_profile_record_alloc(void *ptr, size_t size, void *caller) {
+	mm_profile_countdown = next_countdown();
+
+	void *frames[HEAP_DEPTH + MAX_DEPTH];
+	int depth = backtrace(frames, HEAP_DEPTH + MAX_DEPTH);
+	int first = 1;          /* skip this function */
+	for (int i = 1; i < depth && i <= HEAP_DEPTH; i++) {
+		if (frames[i] == caller) {
+			first = i;      /* and the heap frames below the caller */
+			break;
+		}
+	}
+	depth -= first;
+	if (depth > MAX_DEPTH) {
+		depth = MAX_DEPTH;
+	}
+
+	pthread_mutex_lock(&profile_lock);
+	remove_sample(ptr);     /* stale sample of storage freed by a heap reset */
+	Stack *stack = find_stack(frames + first, depth);
+	Sample *sample = free_samples;
+	if (sample != NULL) {
+		free_samples = sample->next;
+	} else {
+		sample = malloc(sizeof(Sample));
+	}
+	if (stack != NULL && sample != NULL) {
+		sample->ptr = ptr;
+		sample->size = size;
+		sample->stack = stack;
+		size_t b = sample_bucket(ptr);
+		sample->next = samples[b];
+		samples[b] = sample;
+		stack->live_count++;
+		stack->live_bytes += size;
+		stack->alloc_count++;
+		stack->alloc_bytes += size;
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Record that a sampled allocation was freed.
+ *
+ * @param ptr the freed storage
+ */
+void mm_profile_record_free(void *ptr) {
+	pthread_mutex_lock(&profile_lock);
+	remove_sample(ptr);
+	pthread_mutex_unlock(&profile_lock);
+}
+
+/**
+ * Write the name of a frame: the function name from its symbol if
+ * there is one, otherwise its address.
+ *
+ * @param out the stream to write to
+ * @param symbol the symbol from backtrace_symbols, e.g. "prog(func+0x1a) [0x4005d4]"
+ * @param frame the return address
+ */
+static void write_frame(FILE *out, const char *symbol, void *frame) {
+	const char *open = (symbol != NULL) ? strchr(symbol, '(') : NULL;
+	if (open != NULL) {
+		size_t len = strcspn(open + 1, "+)");
+		if (len > 0) {
+			fprintf(out, "%.*s", (int)len, open + 1);
+			return;
+		}
+	}
+	fprintf(out, "%p", frame);
+}
+
+/**
+ * Write the stacks as folded lines, outermost frame first.
+ * Called with profile_lock held.
+ */
+static int dump_folded(FILE *out, bool live) {
+	int nstacks = 0;
+	for (size_t b = 0; b < STACK_BUCKETS; b++) {
+		for (Stack *s = stacks[b]; s != NULL; s = s->next) {
+			size_t bytes = live ? s->live_bytes : s->alloc_bytes;
+			if (bytes == 0) {
+				continue;
+			}
+			char **symbols = backtrace_symbols(s->frames, s->depth);
+			for (int i = s->depth - 1; i >= 0; i--) {
+				write_frame(out, (symbols != NULL) ? symbols[i] : NULL, s->frames[i]);
+				fputc((i > 0) ? ';' : ' ', out);
+			}
+			fprintf(out, "%zu\n", bytes);
+			free(symbols);
+			nstacks++;
+		}
+	}
+	return nstacks;
+}
+
+/**
+ * Write the stacks as a legacy pprof heap profile. pprof scales the
+ * sampled counts by the sampling interval in the header.
+ * Called with profile_lock held.
+ */
+static int dump_pprof(FILE *out) {
+	size_t live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+	for (size_t b = 0; b < STACK_BUCKETS; b++) {
+		for (Stack *s = stacks[b]; s != NULL; s = s->next) {
+			live_count += s->live_count;
+			live_bytes += s->live_bytes;
+			alloc_count += s->alloc_count;
+			alloc_bytes += s->alloc_bytes;
+		}
+	}
+	fprintf(out, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+			live_count, live_bytes, alloc_count, alloc_bytes, profile_interval);
+
+	int nstacks = 0;
+	for (size_t b = 0; b < STACK_BUCKETS; b++) {
+		for (Stack *s = stacks[b]; s != NULL; s = s->next) {
+			fprintf(out, "%zu: %zu [%zu: %zu] @",
+					s->live_count, s->live_bytes, s->alloc_count, s->alloc_bytes);
+			for (int i = 0; i < s->depth; i++) {
+				fprintf(out, " %p", s->frames[i]);
+			}
+			fputc('\n', out);
+			nstacks++;
+		}
+	}
+
+	/* pprof symbolizes the addresses with the mappings of the process */
+	fprintf(out, "\nMAPPED_LIBRARIES:\n");
+	FILE *maps = fopen("/proc/self/maps", "r");
+	if (maps != NULL) {
+		char line[512];
+		while (fgets(line, sizeof(line), maps) != NULL) {
+			fputs(line, out);
+		}
+		fclose(maps);
+	}
+	return nstacks;
+}
+
+/**
+ * Write the samples taken so far.
+ *
+ * @param out the stream to write to
+ * @param format the format of the dump
+ * @return the number of distinct call stacks written
+ */
+int mm_profile_dump(FILE *out, MMProfileFormat format) {
+	pthread_mutex_lock(&profile_lock);
+	int nstacks;
+	switch (format) {
+	case MM_PROFILE_FOLDED_LIVE:
+		nstacks = dump_folded(out, true);
+		break;
+	case MM_PROFILE_FOLDED_ALLOCATED:
+		nstacks = dump_folded(out, false);
+		break;
+	default:
+		nstacks = dump_pprof(out);
+	}
+	pthread_mutex_unlock(&profile_lock);
+	return nstacks;
+}
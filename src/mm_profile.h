@@ -0,0 +1,97 @@
+/*
+ * mm_profile.h - sampling heap profiler.
+ *
+ * Allocations are sampled at a geometric byte interval: on average one
+ * sample every interval bytes allocated, so a large allocation is more
+ * likely to be picked than a small one. Each sample captures the call
+ * stack of the allocation and stays in a live-sample table until the
+ * block is freed. The samples can be dumped as a pprof heap profile or
+ * as folded stacks for flame graphs.
+ */
+
+#ifndef MM_PROFILE_H_
+#define MM_PROFILE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Formats of a profile dump */
+typedef enum {
+	MM_PROFILE_PPROF,             /* legacy pprof heap profile text */
+	MM_PROFILE_FOLDED_LIVE,       /* folded stacks weighted by live bytes */
+	MM_PROFILE_FOLDED_ALLOCATED   /* folded stacks weighted by allocated bytes */
+} MMProfileFormat;
+
+/**
+ * Start sampling allocations.
+ *
+ * @param interval the mean number of bytes allocated between samples
+ */
+void mm_profile_start(size_t interval);
+
+/**
+ * Stop sampling allocations. Samples taken so far are kept.
+ */
+void mm_profile_stop(void);
+
+/**
+ * Forget the live samples, e.g. because the heap was reset.
+ * The allocated totals are kept.
+ */
+void mm_profile_reset(void);
+
+/**
+ * Write the samples taken so far.
+ *
+ * @param out the stream to write to
+ * @param format the format of the dump
+ * @return the number of distinct call stacks written
+ */
+int mm_profile_dump(FILE *out, MMProfileFormat format);
+
+/*
+ * Used by the heap to sample its allocations.
+ */
+
+/** true while sampling */
+extern bool mm_profile_enabled;
+
+/** bytes the calling thread still allocates before the next sample */
+extern __thread size_t mm_profile_countdown;
+
+/**
+ * Record a sampled allocation with the call stack of the caller. The
+ * stack starts at the caller of the heap, leaving out the frames of
+ * the heap and the profiler.
+ *
+ * @param ptr the allocated storage
+ * @param size the requested size
+ * @param caller the return address of the heap call, from
+ *        __builtin_return_address(0) in mm_malloc, or NULL to keep
+ *        every frame above the profiler
+ */
+void mm_profile_record_alloc(void *ptr, size_t size, void *caller);
+
+/**
+ * Record that a sampled allocation was freed.
+ *
+ * @param ptr the freed storage
+ */
+void mm_profile_record_free(void *ptr);
+
+/**
+ * Count an allocation towards the next sample.
+ *
+ * @param size the requested size
+ * @return true if the allocation is to be sampled
+ */
+static inline bool mm_profile_sample(size_t size) {
+	if (size < mm_profile_countdown) {
+		mm_profile_countdown -= size;
+		return false;
+	}
+	return true;
+}
+
+#endif /* MM_PROFILE_H_ */
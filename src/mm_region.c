@@ -0,0 +1,181 @@
+/*
+ * mm_region.c - region allocator for memory with a shared lifetime.
+ *
+ * The chunks of a region form a stack, newest first. Allocation bumps
+ * the top of the newest chunk, and a release pops the chunks allocated
+ * after the mark, so its cost depends on the chunks rather than the
+ * blocks. Popped chunks of the region's chunk size are kept for reuse;
+ * larger chunks made for big requests go back to the heap.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "mm_heap.h"
+#include "mm_region.h"
+
+/** Default bytes taken from the heap at a time */
+#ifndef REGION_CHUNK_SIZE
+#define REGION_CHUNK_SIZE (16*1024)
+#endif
+
+/** Alignment of region blocks */
+#define REGION_ALIGN _Alignof(max_align_t)
+
+/** Round n up to the region alignment */
+#define REGION_ROUND(n) (((n) + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1))
+
+/** Header of a chunk */
+typedef struct Chunk {
+	struct Chunk *prev;         /* chunk allocated before this one */
+	char *limit;                /* end of the chunk */
+} Chunk;
+
+/** Bytes of a chunk header, keeping its blocks aligned */
+#define CHUNK_HEADER REGION_ROUND(sizeof(Chunk))
+
+/** A region */
+struct MMRegion {
+	Chunk *chunk;               /* newest chunk, or NULL */
+	char *top;                  /* next free byte of the newest chunk */
+	Chunk *spare;               /* released chunks of chunk_size */
+	size_t chunk_size;          /* bytes taken from the heap at a time */
+};
+
+/**
+ * Create a region.
+ *
+ * @param chunk_size the bytes to take from the heap at a time,
+ *   or 0 for the default
+ * @return the region, or NULL if not available
+ */
+MMRegion *mm_region_create(size_t chunk_size) {
+	MMRegion *r = mm_malloc(sizeof(MMRegion));
+	if (r == NULL) {
+		return NULL;
+	}
+	if (chunk_size == 0) {
+		chunk_size = REGION_CHUNK_SIZE;
+	}
+	r->chunk = NULL;
+	r->top = NULL;
+	r->spare = NULL;
+	r->chunk_size = REGION_ROUND(chunk_size) + CHUNK_HEADER;
+	return r;
+}
+
+/**
+ * Push a chunk with room for nbytes onto a region.
+ *
+ * @param r the region
+ * @param nbytes the number of bytes needed
+ * @return true if the chunk was added
+ */
+static bool push_chunk(MMRegion *r, size_t nbytes) {
+	Chunk *c;
+	size_t size = CHUNK_HEADER + nbytes;
+	if (size <= r->chunk_size && r->spare != NULL) {
+		c = r->spare;                       /* reuse a released chunk */
+		r->spare = c->prev;
+	} else {
+		if (size <= r->chunk_size) {
+			size = r->chunk_size;
+		}
+		c = mm_malloc(size);
+		if (c == NULL) {
+			return false;
+		}
+		c->limit = (char*)c + size;
+	}
+	c->prev = r->chunk;
+	r->chunk = c;
+	r->top = (char*)c + CHUNK_HEADER;
+	return true;
+}
+
+/**
+ * Pop the newest chunk of a region.
+ *
+ * @param r the region
+ */
+static void pop_chunk(MMRegion *r) {
+	Chunk *c = r->chunk;
+	r->chunk = c->prev;
+	r->top = (r->chunk == NULL) ? NULL : r->chunk->limit;
+	if ((size_t)(c->limit - (char*)c) == r->chunk_size) {
+		c->prev = r->spare;                 /* keep for reuse */
+		r->spare = c;
+	} else {
+		mm_free(c);
+	}
+}
+
+/**
+ * Allocates nbytes of memory from a region, aligned for any type.
+ *
+ * @param r the region
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_region_alloc(MMRegion *r, size_t nbytes) {
+	if (nbytes > SIZE_MAX - CHUNK_HEADER - REGION_ALIGN) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	nbytes = REGION_ROUND(nbytes);
+	if (r->chunk == NULL || (size_t)(r->chunk->limit - r->top) < nbytes) {
+		if (!push_chunk(r, nbytes)) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	void *p = r->top;
+	r->top += nbytes;
+	return p;
+}
+
+/**
+ * Mark the current point of a region.
+ *
+ * @param r the region
+ * @return the mark
+ */
+MMRegionMark mm_region_mark(MMRegion *r) {
+	MMRegionMark mark = { r->chunk, r->top };
+	return mark;
+}
+
+/**
+ * Free everything allocated from a region since a mark was taken.
+ * Marks taken after this mark are no longer valid.
+ *
+ * @param r the region
+ * @param mark the mark to release to
+ */
+void mm_region_release(MMRegion *r, MMRegionMark mark) {
+	while (r->chunk != mark.chunk) {
+		pop_chunk(r);
+	}
+	r->top = mark.top;
+}
+
+/**
+ * Free a region and everything allocated from it.
+ *
+ * @param r the region
+ */
+void mm_region_destroy(MMRegion *r) {
+	if (r == NULL) {
+		return;
+	}
+	while (r->chunk != NULL) {
+		pop_chunk(r);
+	}
+	while (r->spare != NULL) {
+		Chunk *c = r->spare;
+		r->spare = c->prev;
+		mm_free(c);
+	}
+	mm_free(r);
+}
@@ -0,0 +1,67 @@
+/*
+ * mm_region.h - region allocator for memory with a shared lifetime.
+ *
+ * A region bump-allocates from chunks taken from the heap with
+ * mm_malloc. Its blocks are never freed one at a time: releasing the
+ * region to a mark frees everything allocated after the mark, and
+ * destroying it frees everything at once. Typical use is one region
+ * per request, marked at the start and released at the end.
+ */
+
+#ifndef MM_REGION_H_
+#define MM_REGION_H_
+
+#include <stddef.h>
+
+/** A region */
+typedef struct MMRegion MMRegion;
+
+/** A point in a region to release back to */
+typedef struct {
+	void *chunk;                /* current chunk at the mark */
+	char *top;                  /* next free byte of the chunk */
+} MMRegionMark;
+
+/**
+ * Create a region.
+ *
+ * @param chunk_size the bytes to take from the heap at a time,
+ *   or 0 for the default
+ * @return the region, or NULL if not available
+ */
+MMRegion *mm_region_create(size_t chunk_size);
+
+/**
+ * Allocates nbytes of memory from a region, aligned for any type.
+ *
+ * @param r the region
+ * @param nbytes the number of bytes to allocate
+ * @return pointer to allocated memory or NULL if not available.
+ */
+void *mm_region_alloc(MMRegion *r, size_t nbytes);
+
+/**
+ * Mark the current point of a region.
+ *
+ * @param r the region
+ * @return the mark
+ */
+MMRegionMark mm_region_mark(MMRegion *r);
+
+/**
+ * Free everything allocated from a region since a mark was taken.
+ * Marks taken after this mark are no longer valid.
+ *
+ * @param r the region
+ * @param mark the mark to release to
+ */
+void mm_region_release(MMRegion *r, MMRegionMark mark);
+
+/**
+ * Free a region and everything allocated from it.
+ *
+ * @param r the region
+ */
+void mm_region_destroy(MMRegion *r);
+
+#endif /* MM_REGION_H_ */
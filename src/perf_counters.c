@@ -0,0 +1,194 @@
+/*
+ * perf_counters.c - optional hardware performance counters, read with
+ *                   perf_event_open around the timed heap calls.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+/* encodes a hardware cache event */
+#define CACHE_EVENT(cache, op, result) \
+	((cache) | ((op) << 8) | ((result) << 16))
+
+/** Events that can be requested by name */
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} events[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "l1d-load-misses", PERF_TYPE_HW_CACHE,
+	  CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "llc-load-misses", PERF_TYPE_HW_CACHE,
+	  CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "dtlb-load-misses", PERF_TYPE_HW_CACHE,
+	  CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "dtlb-store-misses", PERF_TYPE_HW_CACHE,
+	  CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/** Layout of a group read */
+typedef struct {
+	uint64_t nr;                            /* number of counters in the group */
+	uint64_t time_enabled;                  /* time the group was enabled */
+	uint64_t time_running;                  /* time the group was on the PMU */
+	uint64_t values[PERF_MAX_COUNTERS];     /* counter values in group order */
+} GroupRead;
+
+/**
+ * Open a single counter for the calling thread.
+ *
+ * @param name the event name
+ * @param group the group leader descriptor, or -1 to open a leader
+ * @return the counter descriptor, or -1 if not available
+ */
+static int open_counter(const char *name, int group) {
+	for (size_t i = 0; i < sizeof(events)/sizeof(events[0]); i++) {
+		if (strcmp(events[i].name, name) == 0) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = events[i].type;
+			attr.config = events[i].config;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP
+					| PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+		}
+	}
+	return -1;
+}
+
+/**
+ * Read the current values of the group.
+ *
+ * @param pc the counter set
+ * @param gr the values read
+ * @return non-zero if the group could be read
+ */
+static int read_group(const PerfCounters *pc, GroupRead *gr) {
+	ssize_t n = read(pc->leader, gr, sizeof(*gr));
+	return n >= (ssize_t)(3 * sizeof(uint64_t));
+}
+
+/**
+ * perf_counters_open - open a set of named counters for the calling
+ *    thread, counting user space only.
+ *
+ * @param pc the counter set
+ * @param names the event names
+ * @param n the number of names
+ * @return the number of counters that are available
+ */
+int perf_counters_open(PerfCounters *pc, const char *const names[], int n) {
+	memset(pc, 0, sizeof(*pc));
+	pc->leader = -1;
+	int navailable = 0;
+	for (int i = 0; i < n && i < PERF_MAX_COUNTERS; i++) {
+		pc->names[i] = names[i];
+		pc->fds[i] = open_counter(names[i], pc->leader);
+		if (pc->fds[i] >= 0) {
+			if (pc->leader < 0) {
+				pc->leader = pc->fds[i];    /* first counter opened leads the group */
+			}
+			pc->slots[i] = navailable++;
+		}
+		pc->ncounters++;
+	}
+	return navailable;
+}
+
+/**
+ * perf_counters_available - returns whether a counter could be opened.
+ */
+int perf_counters_available(const PerfCounters *pc, int i) {
+	return pc->fds[i] >= 0;
+}
+
+/**
+ * perf_counters_start - record the current counter values.
+ */
+void perf_counters_start(PerfCounters *pc) {
+	GroupRead gr;
+	if (pc->leader < 0 || !read_group(pc, &gr)) {
+		return;
+	}
+	pc->start_enabled = gr.time_enabled;
+	pc->start_running = gr.time_running;
+	for (int i = 0; i < pc->ncounters; i++) {
+		if (pc->fds[i] >= 0) {
+			pc->start[i] = gr.values[pc->slots[i]];
+		}
+	}
+}
+
+/**
+ * perf_counters_stop - set last to the counts since perf_counters_start
+ *    and add them to the totals.
+ */
+void perf_counters_stop(PerfCounters *pc) {
+	GroupRead gr;
+	memset(pc->last, 0, sizeof(pc->last));
+	if (pc->leader < 0 || !read_group(pc, &gr)) {
+		return;
+	}
+	uint64_t enabled = gr.time_enabled - pc->start_enabled;
+	uint64_t running = gr.time_running - pc->start_running;
+	if (running < enabled) {
+		pc->multiplexed = 1;
+	}
+	for (int i = 0; i < pc->ncounters; i++) {
+		if (pc->fds[i] >= 0) {
+			uint64_t count = gr.values[pc->slots[i]] - pc->start[i];
+			if (running > 0 && running < enabled) {
+				count = (uint64_t)((double)count * enabled / running);
+			}
+			pc->last[i] = count;
+			pc->totals[i] += count;
+		}
+	}
+}
+
+/**
+ * perf_counters_clear - zero the totals and the multiplexed flag.
+ */
+void perf_counters_clear(PerfCounters *pc) {
+	memset(pc->totals, 0, sizeof(pc->totals));
+	pc->multiplexed = 0;
+}
+
+/**
+ * perf_counters_find - find a counter of the set by event name.
+ */
+int perf_counters_find(const PerfCounters *pc, const char *name) {
+	for (int i = 0; i < pc->ncounters; i++) {
+		if (pc->fds[i] >= 0 && strcmp(pc->names[i], name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * perf_counters_close - close the counters in the set.
+ */
+void perf_counters_close(PerfCounters *pc) {
+	for (int i = 0; i < pc->ncounters; i++) {
+		if (pc->fds[i] >= 0 && pc->fds[i] != pc->leader) {
+			close(pc->fds[i]);
+		}
+		pc->fds[i] = -1;
+	}
+	if (pc->leader >= 0) {
+		close(pc->leader);                  /* close the leader last */
+		pc->leader = -1;
+	}
+	pc->ncounters = 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * perf_counters.h - optional hardware performance counters, read with
+ *                   perf_event_open around the timed heap calls.
+ *
+ * The counters of a set are opened as one event group so that they are
+ * scheduled together and read with a single read(). If the kernel has
+ * to multiplex the group with other events, the counts are scaled by
+ * the fraction of the time the group was running.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stdint.h>
+
+/** Maximum number of counters in a set */
+#define PERF_MAX_COUNTERS 8
+
+/** A set of counters for the calling thread */
+typedef struct {
+	int ncounters;                          /* number of counters in the set */
+	const char *names[PERF_MAX_COUNTERS];   /* event name of each counter */
+	int fds[PERF_MAX_COUNTERS];             /* counter descriptor, -1 if not available */
+	int slots[PERF_MAX_COUNTERS];           /* position of the counter in a group read */
+	int leader;                             /* descriptor of the group leader, -1 if none */
+	uint64_t start[PERF_MAX_COUNTERS];      /* values read by perf_counters_start */
+	uint64_t start_enabled;                 /* group time enabled at perf_counters_start */
+	uint64_t start_running;                 /* group time running at perf_counters_start */
+	uint64_t last[PERF_MAX_COUNTERS];       /* counts between the last start and stop */
+	uint64_t totals[PERF_MAX_COUNTERS];     /* counts accumulated between start and stop */
+	int multiplexed;                        /* non-zero if counts were scaled */
+} PerfCounters;
+
+/**
+ * perf_counters_open - open a set of named counters for the calling
+ *    thread, counting user space only. Counters the kernel or hardware
+ *    does not support are left unavailable.
+ *
+ * @param pc the counter set
+ * @param names the event names: "cycles", "instructions",
+ *    "l1d-load-misses", "llc-load-misses", "dtlb-load-misses",
+ *    "dtlb-store-misses", or "branch-misses"
+ * @param n the number of names
+ * @return the number of counters that are available
+ */
+int perf_counters_open(PerfCounters *pc, const char *const names[], int n);
+
+/**
+ * perf_counters_available - returns whether a counter could be opened.
+ *
+ * @param pc the counter set
+ * @param i the counter index
+ * @return non-zero if the counter is available
+ */
+int perf_counters_available(const PerfCounters *pc, int i);
+
+/**
+ * perf_counters_start - record the current counter values.
+ *
+ * @param pc the counter set
+ */
+void perf_counters_start(PerfCounters *pc);
+
+/**
+ * perf_counters_stop - set last to the counts since perf_counters_start
+ *    and add them to the totals.
+ *
+ * @param pc the counter set
+ */
+void perf_counters_stop(PerfCounters *pc);
+
+/**
+ * perf_counters_clear - zero the totals and the multiplexed flag.
+ *
+ * @param pc the counter set
+ */
+void perf_counters_clear(PerfCounters *pc);
+
+/**
+ * perf_counters_find - find a counter of the set by event name.
+ *
+ * @param pc the counter set
+ * @param name the event name
+ * @return the counter index, or -1 if the set has no available counter
+ *    for the event
+ */
+int perf_counters_find(const PerfCounters *pc, const char *name);
+
+/**
+ * perf_counters_close - close the counters in the set.
+ *
+ * @param pc the counter set
+ */
+void perf_counters_close(PerfCounters *pc);
+
+#endif /* PERF_COUNTERS_H_ */
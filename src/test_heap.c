@@ -5,36 +5,1374 @@
  * @author philip gust
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <sched.h>
+#include <libgen.h>
+#include <errno.h>
 #include "mm_heap.h"
+#include "memlib.h"
+#include "perf_counters.h"
+#include "mm_profile.h"
+#include "mm_pool.h"
+#include "mm_region.h"
+#include "trace.h"
+#include "bench_stats.h"
+
+/** Default mean bytes allocated between profile samples */
+#define PROFILE_INTERVAL (64*1024)
+
+/** Objects live at once in the pool benchmark */
+#define POOL_OBJECTS 50000
+
+/** Rounds of freeing and reallocating half the objects in the pool benchmark */
+#define POOL_ROUNDS 20
+
+/** Blocks allocated by each request of the region benchmark */
+#define REQUEST_BLOCKS 256
+
+/** Blocks allocated and released inside a nested mark of each request */
+#define REQUEST_NESTED 32
+
+/** Largest of the small blocks of a request */
+#define REQUEST_MAX_BLOCK 512
+
+/** Size of one block in this many, larger than a region chunk */
+#define REQUEST_BIG_EVERY 64
+#define REQUEST_BIG_BLOCK (64*1024)
+
+/** Default ops between heap snapshots */
+#define SNAPSHOT_OPS 1000
+
+/** Block ids checked in full by sampled verification, one in this many */
+#define VERIFY_SAMPLE_RATE 8
+
+/** Bytes compared at once when checking a fill pattern */
+#define CHECK_CHUNK 256
+
+/** How the payloads of the blocks are verified */
+typedef enum {
+	VERIFY_FULL,        /* fill blocks with a pattern and check all of it */
+	VERIFY_SAMPLED,     /* fill and check one block id in VERIFY_SAMPLE_RATE */
+	VERIFY_CHECKSUM,    /* write and check a tag at both ends of every block */
+	VERIFY_OFF          /* leave the payloads alone */
+} VerifyMode;
+
+/** Names of the verification modes for -V */
+static const char *verify_names[] = { "full", "sampled", "checksum", "off" };
+
+/** Names of the lifetime prediction modes for -L, in MMLifetimeMode order */
+static const char *lifetime_names[] = { "off", "sizes", "sites" };
 
 /**
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: test_heap [-hvd]] <file1> [...<file>]\n");
+    fprintf(stderr, "Usage: test_heap [-hvdHtcN] [-p <file>] [-F <file>] [-S <bytes>] [-P <bytes>] [-R <reqs>] [-E <bytes>] [-m <file>] [-M <ops>] [-V <mode>]\n");
+    fprintf(stderr, "                 [-L <mode>]");
+    fprintf(stderr, " [-w <runs>] [-r <runs>] [-C <cpu>] [-o <file>] [-b <file>] [-B <file>] [-T <tolerances>] [-X <bytes>]\n");
+    fprintf(stderr, "                 <file1> [...<file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-v         Print detailed performance info.\n");
     fprintf(stderr, "\t-d         Print debug information.\n");
+    fprintf(stderr, "\t-H         Back the heap with huge pages.\n");
+    fprintf(stderr, "\t-t         Count dTLB misses in the heap calls.\n");
+    fprintf(stderr, "\t-c         Count cycles, instructions, cache, dTLB, and branch misses per op type.\n");
+    fprintf(stderr, "\t-N         Compare allocating from the local and a remote NUMA node.\n");
+    fprintf(stderr, "\t-p <file>  Sample allocations and write a pprof heap profile to <file>.\n");
+    fprintf(stderr, "\t-F <file>  Sample allocations and write folded stacks of allocated bytes to <file>.\n");
+    fprintf(stderr, "\t-S <bytes> Mean bytes allocated between samples (default %d).\n", PROFILE_INTERVAL);
+    fprintf(stderr, "\t-P <bytes> Benchmark a pool of <bytes> objects against mm_malloc.\n");
+    fprintf(stderr, "\t-R <reqs>  Benchmark a region marked and released per request against mm_malloc and mm_free.\n");
+    fprintf(stderr, "\t-E <bytes> Allocate <bytes> blocks until the heap is full and fail if it stopped short.\n");
+    fprintf(stderr, "\t-m <file>  Append heap snapshots taken during the replays to <file>.\n");
+    fprintf(stderr, "\t-M <ops>   Ops between heap snapshots (default %d).\n", SNAPSHOT_OPS);
+    fprintf(stderr, "\t-V <mode>  Verify payloads in a replay before the timed one: full, sampled, checksum, or off (default full).\n");
+    fprintf(stderr, "\t-L <mode>  Replay again placing blocks by lifetime predicted from sizes or sites, and compare the heap.\n");
+    fprintf(stderr, "\t-w <runs>  Untimed warm-up replays of each trace (default 0).\n");
+    fprintf(stderr, "\t-r <runs>  Timed replays of each trace, summarized by median, min, stddev, and 95%% CI (default 1);\n\t           op latencies come from one more replay that times each op.\n");
+    fprintf(stderr, "\t-C <cpu>   Pin the process to <cpu>.\n");
+    fprintf(stderr, "\t-o <file>  Write the results to <file>, as CSV if it ends in .csv, otherwise as JSON.\n");
+    fprintf(stderr, "\t-b <file>  Save the results to baseline <file>.\n");
+    fprintf(stderr, "\t-B <file>  Compare the results with baseline <file> and fail if a trace regressed.\n");
+    fprintf(stderr, "\t-T <tolerances> Percent change allowed per metric, e.g. kops=5,p99=10,heap=1,util=1 (the defaults).\n");
+    fprintf(stderr, "\t-X <bytes> Maximum heap size, with an optional K, M or G suffix (default MM_MAX_HEAP or 20M).\n");
     fprintf(stderr, "\t<file>     Use <file> as the trace file.\n");
 }
 
+/** Op types whose counters are reported separately */
+enum { OP_MALLOC, OP_REALLOC, OP_FREE, NOPTYPES };
+
+/** Names of the op types */
+static const char *op_names[NOPTYPES] = { "malloc", "realloc", "free" };
+
 /** Structure for individual trace results */
 typedef struct {
 	char *traceName;
-	int leaks;
-	int errors;
-	int ops;
-	float secs;
+	uint64_t leaks;
+	uint64_t errors;
+	uint64_t ops;
+	double secs;
+	uint64_t tlbmisses;
+	double remotesecs;
+	size_t copied;
+	uint64_t opcounts[NOPTYPES];
+	uint64_t counts[NOPTYPES][PERF_MAX_COUNTERS];
+	size_t heapsize;                    /* peak heap size */
+	size_t peaklive;                    /* peak bytes requested by live blocks */
+	size_t lifeheap;                    /* peak heap size placing blocks by lifetime */
+	uint64_t lifeerrors;                /* errors replaying with lifetime placement */
+	SampleStats kops;                   /* throughput of the timed replays */
+	SampleStats nsop;                   /* mean latency per op of the timed replays */
+	LatencyHist latency;                /* latencies of the ops of the sampled replay */
 } TraceInfo;
 
+/** Latency percentiles reported per trace */
+static const double latency_percentiles[] = { 50, 90, 99, 99.9 };
+
+/** Labels of latency_percentiles */
+static const char *const percentile_labels[] = { "p50", "p90", "p99", "p999" };
+
+/** Number of latency_percentiles */
+#define NPERCENTILES (sizeof(latency_percentiles)/sizeof(latency_percentiles[0]))
+
+/** Metrics compared with a baseline */
+typedef enum { METRIC_KOPS, METRIC_P99, METRIC_HEAP, METRIC_UTIL, NMETRICS } Metric;
+
+/** Names of the metrics for -T */
+static const char *const metric_names[NMETRICS] = { "kops", "p99", "heap", "util" };
+
+/** Whether a larger value of each metric is better */
+static const bool metric_higher_better[NMETRICS] = { true, false, false, true };
+
+/** Decimal places of each metric when printed */
+static const int metric_decimals[NMETRICS] = { 0, 0, 0, 4 };
+
+/** Default percent change of each metric allowed before a trace regresses */
+static const double metric_tolerance[NMETRICS] = { 5, 10, 1, 1 };
+
+/** Results of a trace saved in a baseline */
+typedef struct {
+	char *name;                         /* trace file name without its directory */
+	double metrics[NMETRICS];
+	uint64_t errors;
+} BaselineEntry;
+
+/** Names of the heap backings reported by mem_page_backing() */
+static const char *page_backing[] = {
+	"base pages", "transparent huge pages", "hugetlb pages"
+};
+
+/** Counters sampled around the heap calls; -t uses just the dTLB misses */
+static const char *const counter_events[] = {
+	"dtlb-load-misses", "dtlb-store-misses",
+	"cycles", "instructions", "l1d-load-misses", "llc-load-misses", "branch-misses"
+};
+
+/** Number of dTLB miss counters at the start of counter_events */
+#define TLB_EVENTS 2
+
+/** Column labels of counter_events */
+static const char *const counter_labels[] = {
+	"dTLBld", "dTLBst", "cycles", "instrs", "L1dmiss", "LLCmiss", "brmiss"
+};
+
+/**
+ * Read the monotonic clock.
+ * @return the time in ns
+ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Overhead of reading the clock, subtracted from the latency of each heap call */
+static uint64_t timer_overhead_ns = 0;
+
+/**
+ * Measure the overhead of reading the clock as the least time between
+ * two reads in a row.
+ * @return the overhead in ns
+ */
+static uint64_t measure_timer_overhead(void) {
+	uint64_t least = UINT64_MAX;
+	for (int i = 0; i < 1000; i++) {
+		uint64_t t = now_ns();
+		t = now_ns() - t;
+		if (t < least) least = t;
+	}
+	return least;
+}
+
+/**
+ * Get the latency of a heap call timed from start, less the timer overhead.
+ * @param start the time read before the call
+ * @return the latency in ns
+ */
+static uint64_t op_latency(uint64_t start) {
+	uint64_t t = now_ns() - start;
+	return (t > timer_overhead_ns) ? t - timer_overhead_ns : 0;
+}
+
+/**
+ * Stop the counters around a heap call and add their counts to its op type.
+ * @param info the trace results
+ * @param counters the counters
+ * @param op the op type of the heap call
+ */
+static void stop_counters(TraceInfo *info, PerfCounters *counters, int op) {
+	perf_counters_stop(counters);
+	for (int i = 0; i < counters->ncounters; i++) {
+		info->counts[op][i] += counters->last[i];
+	}
+}
+
+/**
+ * Print the heap statistics kept by a heap compiled with MM_STATS.
+ * @param stats the heap statistics
+ */
+static void print_stats(const MMStats *stats) {
+	fprintf(stderr, "Heap statistics:\n");
+	fprintf(stderr, "  free list searches %zu, probes %zu (%.2f per search, max %zu), fast bin hits %zu\n",
+			stats->searches, stats->probes,
+			stats->searches ? (double)stats->probes/stats->searches : 0.0,
+			stats->max_probes, stats->fastbin_hits);
+	fprintf(stderr, "  probes per search:");
+	for (int i = 0; i < MM_PROBE_BUCKETS; i++) {
+		if (stats->probe_hist[i] > 0) {
+			fprintf(stderr, " %s%zu:%zu", (i == MM_PROBE_BUCKETS-1) ? ">=" : "",
+					(size_t)1 << i, stats->probe_hist[i]);
+		}
+	}
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  splits %zu, coalesces lower %zu upper %zu both %zu\n",
+			stats->splits, stats->coalesce_lower, stats->coalesce_upper, stats->coalesce_both);
+	fprintf(stderr, "  heap growth %zu calls, %zu bytes, largest %zu bytes\n",
+			stats->growth_calls, stats->growth_bytes, stats->growth_max);
+	fprintf(stderr, "  realloc copies %zu, %zu bytes\n",
+			stats->realloc_copies, stats->realloc_copy_bytes);
+	if (stats->short_allocs > 0 || stats->missed_short > 0) {
+		fprintf(stderr, "  short-lived heap %zu mallocs, %zu survived; %zu short-lived blocks elsewhere\n",
+				stats->short_allocs, stats->short_survivors, stats->missed_short);
+	}
+	if (stats->compact_moves > 0 || stats->trim_calls > 0) {
+		fprintf(stderr, "  compaction %zu moves, %zu bytes; trims %zu, %zu bytes\n",
+				stats->compact_moves, stats->compact_bytes, stats->trim_calls, stats->trim_bytes);
+	}
+}
+
+/**
+ * Check that a range holds one byte value, a chunk of words at a time
+ * so that the compiler can vectorize the comparison.
+ * @param p the range
+ * @param size the bytes in the range
+ * @param byte the expected value
+ * @return true if every byte in the range is the value
+ */
+static bool check_pattern(const unsigned char *p, size_t size, unsigned char byte) {
+	uint64_t pattern = byte * 0x0101010101010101ull;
+	size_t i = 0;
+	for (; i + CHECK_CHUNK <= size; i += CHECK_CHUNK) {
+		uint64_t diff = 0;
+		for (size_t j = 0; j < CHECK_CHUNK; j += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, p + i + j, sizeof(word));
+			diff |= word ^ pattern;
+		}
+		if (diff != 0) {
+			return false;
+		}
+	}
+	for (; i < size; i++) {
+		if (p[i] != byte) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Tag written at both ends of a block by checksum verification, or
+ * just at the start if the block is too small for two.
+ * @param index the block id
+ * @return the tag
+ */
+static uint64_t block_tag(size_t index) {
+	return (uint64_t)(index + 1) * 0x9e3779b97f4a7c15ull;
+}
+
+/**
+ * Fill the bytes of a block from an offset to its end so that a check
+ * can show whether they were kept by realloc and not overwritten.
+ * @param p the block
+ * @param from the first byte to fill, 0 unless the bytes before it were already filled
+ * @param size the bytes in the block
+ * @param index the block id
+ * @param mode the verification mode
+ */
+static void fill_block(void *p, size_t from, size_t size, size_t index, VerifyMode mode) {
+	switch (mode) {
+	case VERIFY_SAMPLED:
+		if (index % VERIFY_SAMPLE_RATE != 0) {
+			break;
+		}
+		/* fall through */
+	case VERIFY_FULL:
+		/* fill range with low byte of index */
+		memset((char*)p + from, (index & 0xFF), size - from);
+		break;
+	case VERIFY_CHECKSUM: {
+		uint64_t tag = block_tag(index);
+		size_t n = (size < sizeof(tag)) ? size : sizeof(tag);
+		memcpy(p, &tag, n);
+		if (size >= 2*sizeof(tag)) {
+			memcpy((char*)p + size - n, &tag, n);
+		}
+		break;
+	}
+	case VERIFY_OFF:
+		break;
+	}
+}
+
+/**
+ * Check the bytes of a block filled by fill_block.
+ * @param p the block
+ * @param filled the bytes filled
+ * @param valid the bytes still expected to be kept, at most filled
+ * @param index the block id
+ * @param mode the verification mode
+ * @return true if the bytes are as filled
+ */
+static bool check_block(const void *p, size_t filled, size_t valid, size_t index, VerifyMode mode) {
+	switch (mode) {
+	case VERIFY_SAMPLED:
+		if (index % VERIFY_SAMPLE_RATE != 0) {
+			return true;
+		}
+		/* fall through */
+	case VERIFY_FULL:
+		return check_pattern(p, valid, (index & 0xFF));
+	case VERIFY_CHECKSUM: {
+		uint64_t tag = block_tag(index);
+		size_t n = (filled < sizeof(tag)) ? filled : sizeof(tag);
+		return (valid < n || memcmp(p, &tag, n) == 0)
+			&& (valid < filled || filled < 2*sizeof(tag)
+				|| memcmp((const char*)p + filled - n, &tag, n) == 0);
+	}
+	case VERIFY_OFF:
+		break;
+	}
+	return true;
+}
+
+/** The blocks of a replay by id, kept as parallel arrays so that a replay that does not verify the payloads only touches the pointers */
+typedef struct {
+	void **blocks;          /* block of each id, NULL if not allocated */
+	size_t *sizes;          /* bytes requested for the block of each id */
+} IdTable;
+
+/**
+ * Replay a trace against the heap and reset the heap afterwards.
+ * The replay is timed as a whole unless sampled, in which case each
+ * heap call is timed for its latency and the time is their sum.
+ * @param info the trace results, with the trace name set
+ * @param trace the trace
+ * @param verbose print detailed performance info
+ * @param debug print debug information
+ * @param counters counters to sample around the heap calls, or NULL
+ * @param snapshots stream to append heap snapshots to, or NULL
+ * @param snapshot_ops ops between heap snapshots
+ * @param verify how to verify the payloads of the blocks
+ * @param sampled time each heap call and record its latency
+ * @return true if there was memory for the ids of the trace
+ */
+static bool replay_trace(TraceInfo *info, const Trace *trace, bool verbose, bool debug,
+		PerfCounters *counters, FILE *snapshots, int snapshot_ops, VerifyMode verify, bool sampled) {
+	bool tlb = (counters != NULL);
+	memset(info->opcounts, 0, sizeof(info->opcounts));
+	memset(info->counts, 0, sizeof(info->counts));
+	memset(&info->latency, 0, sizeof(info->latency));
+	info->ops = 0;
+
+	/* We'll keep the pointers to the allocated blocks and their sizes here... */
+	size_t num_ids = trace->num_ids;
+	IdTable table;
+	table.blocks = calloc(num_ids, sizeof(void*));
+	table.sizes = calloc(num_ids, sizeof(size_t));
+	if (table.blocks == NULL || table.sizes == NULL) {
+		fprintf(stderr, "No memory for the %zu ids of trace %s\n", num_ids, info->traceName);
+		free(table.blocks);
+		free(table.sizes);
+		return false;
+	}
+	void **blocks = table.blocks;
+	size_t *block_sizes = table.sizes;
+
+	/* replay every request in the trace */
+	uint64_t nerrors = 0;
+	uint64_t elapsed_ns = 0;
+	size_t live = 0;
+	info->peaklive = 0;
+	if (tlb) perf_counters_clear(counters);
+	if (debug || verbose) fprintf(stderr, "Processing trace file %s\n",
+			info->traceName);
+
+	mem_reset_peak();
+	uint64_t replay_start = now_ns();
+
+	size_t op_index;
+	for (op_index = 0; op_index < trace->num_ops; ) {
+		size_t index = trace->ids[op_index];
+		size_t size = trace->sizes[op_index];
+		switch(trace->types[op_index]) {
+		case TRACE_ALLOC:
+			if (debug && verbose) fprintf(stderr, "  Allocating block %zu size %zu\n", index, size);
+			if (blocks[index] != NULL) {
+				if (debug) fprintf(stderr, "  Block %zu already allocated\n", index);
+				nerrors++;
+			} else {
+				if (tlb) perf_counters_start(counters);
+				uint64_t t = sampled ? now_ns() : 0;
+				blocks[index] = mm_malloc(size);
+				if (sampled) {
+					t = op_latency(t);
+					elapsed_ns += t;
+					latency_record(&info->latency, t);
+				}
+				if (tlb) stop_counters(info, counters, OP_MALLOC);
+				info->opcounts[OP_MALLOC]++;
+				if (blocks[index] == NULL) {
+					if (debug) fprintf(stderr, "  Block %zu not allocated\n", index);
+					nerrors++;
+				} else {
+					if (debug && verbose) fprintf(stderr, "  Allocated block %zu size %zu\n", index, size);
+					/*
+					 * fill block to make sure that the old data was copied
+					 * to the new block on realloc or free
+					 */
+					fill_block(blocks[index], 0, size, index, verify);
+					block_sizes[index] = size;
+					live += size;
+				}
+			}
+			break;
+		case TRACE_REALLOC:
+			if (debug && verbose) fprintf(stderr, "  Reallocating block %zu size %zu\n", index, size);
+			if (blocks[index] == NULL) {
+				if (debug) fprintf(stderr, "  Block %zu not reallocated\n", index);
+				nerrors++;
+			} else {
+				if (!check_block(blocks[index], block_sizes[index], block_sizes[index], index, verify)) {
+					if (debug) fprintf(stderr, "  Block %zu has unexpected data before realloc.\n", index);
+					nerrors++;
+					/*
+					 * re-fill block to make sure that the old data was copied
+					 * to the new block on realloc or free
+					 */
+					fill_block(blocks[index], 0, block_sizes[index], index, verify);
+				}
+				if (tlb) perf_counters_start(counters);
+				uint64_t t = sampled ? now_ns() : 0;
+				void *b = mm_realloc(blocks[index], size);
+				if (sampled) {
+					t = op_latency(t);
+					elapsed_ns += t;
+					latency_record(&info->latency, t);
+				}
+				if (tlb) stop_counters(info, counters, OP_REALLOC);
+				info->opcounts[OP_REALLOC]++;
+				if (b == NULL) {
+					if (debug) fprintf(stderr, "  Unable to realloc block %zu to size %zu\n", index, size);
+					nerrors++;
+				} else {
+					if (debug && verbose) fprintf(stderr, "  Reallocated block %zu size %zu\n", index, size);
+					blocks[index] = b;
+					size_t kept = (block_sizes[index] < size) ? block_sizes[index] : size;
+					bool ok = check_block(blocks[index], block_sizes[index], kept, index, verify);
+					if (!ok) {
+						if (debug) fprintf(stderr, "  Block %zu has unexpected data after reallocation.\n", index);
+						nerrors++;
+					}
+					/*
+					 * fill the rest of the block, or all of it if the kept data was
+					 * wrong or is not a prefix of the fill, to make sure that the
+					 * old data is copied to the new block on realloc or free
+					 */
+					fill_block(blocks[index], (ok && verify != VERIFY_CHECKSUM) ? kept : 0, size, index, verify);
+					live += size - block_sizes[index];
+					block_sizes[index] = size;
+				}
+			}
+			break;
+		case TRACE_FREE:
+			if (blocks[index] == NULL) {
+				if (debug) fprintf(stderr, "  Block %zu not allocated\n", index);
+				nerrors++;
+			} else {
+				if (debug & verbose) fprintf(stderr, "  Freeing block %zu size %zu\n", index, block_sizes[index]);
+				if (!check_block(blocks[index], block_sizes[index], block_sizes[index], index, verify)) {
+					if (debug) fprintf(stderr, "  Block %zu has unexpected data before free.\n", index);
+					nerrors++;
+				}
+				if (tlb) perf_counters_start(counters);
+				uint64_t t = sampled ? now_ns() : 0;
+				mm_free(blocks[index]);
+				if (sampled) {
+					t = op_latency(t);
+					elapsed_ns += t;
+					latency_record(&info->latency, t);
+				}
+				if (tlb) stop_counters(info, counters, OP_FREE);
+				info->opcounts[OP_FREE]++;
+				if (debug & verbose) fprintf(stderr, "  Freed block %zu size %zu\n", index, block_sizes[index]);
+				blocks[index] = NULL;
+				live -= block_sizes[index];
+				block_sizes[index] = 0;
+			}
+			break;
+		default:
+			if (debug) fprintf(stderr, "Invalid type character (%c) in tracefile %s\n",
+								trace->types[op_index], info->traceName);
+			nerrors++;
+		}
+
+		if (live > info->peaklive) info->peaklive = live;
+
+		op_index++;
+		if (snapshots != NULL && op_index % snapshot_ops == 0) {
+			mm_heap_snapshot(snapshots, op_index);
+		}
+	}
+	if (!sampled) elapsed_ns = now_ns() - replay_start;
+	info->heapsize = mem_peak_heapsize();
+	if (snapshots != NULL && op_index % snapshot_ops != 0) mm_heap_snapshot(snapshots, op_index);
+
+	if (debug || verbose) fprintf(stderr, "Done processing trace file %s\n",
+			info->traceName);
+
+	if ((debug || verbose) && (trace->num_ids != trace->header_ids || trace->num_ops != trace->header_ops)) {
+		fprintf(stderr, "Trace has %zu ids and %zu ops, header gives %zu ids and %zu ops\n",
+				trace->num_ids, trace->num_ops, trace->header_ids, trace->header_ops);
+	}
+
+	info->leaks = 0;
+	info->errors = nerrors;
+
+	// tally and report leaks
+	char *newline = "\n";
+	for (size_t i = 0; i < num_ids; i++) {
+		if (blocks[i] != NULL) {
+			if (debug) fprintf(stderr, "%sblock %zu not freed, size=%zu\n", newline, i, block_sizes[i]);
+			info->leaks++;
+			newline = "";
+		}
+	}
+	free(table.blocks);
+	free(table.sizes);
+
+	if (debug || verbose) fprintf(stderr, "Errors: %llu, leaks: %llu\n",
+			(unsigned long long)info->errors, (unsigned long long)info->leaks);
+	MMStats stats;
+	if (verbose && mm_getstats(&stats)) print_stats(&stats);
+	if (debug || verbose) fprintf(stderr, "\n");
+
+	info->secs = elapsed_ns / 1e9;
+	info->ops = op_index;
+	info->tlbmisses = 0;
+	for (int i = 0; tlb && i < TLB_EVENTS && i < counters->ncounters; i++) {
+		info->tlbmisses += counters->totals[i];
+	}
+	info->copied = mm_realloc_copied();
+
+	// reset memory model for next test
+	mm_reset();
+	return true;
+}
+
+/**
+ * Free the objects of a pool benchmark that are still allocated.
+ * @param pool the pool they came from, or NULL for the heap
+ * @param objects array of POOL_OBJECTS object pointers, NULL where not allocated
+ */
+static void pool_release(MMPool *pool, void **objects) {
+	for (int i = 0; i < POOL_OBJECTS; i++) {
+		if (objects[i] != NULL) {
+			if (pool != NULL) mm_pool_free(pool, objects[i]); else mm_free(objects[i]);
+			objects[i] = NULL;
+		}
+	}
+}
+
+/**
+ * Allocate objects of one size, then repeatedly free half of them in
+ * random order and allocate them again, using either the heap or a pool.
+ * @param size the object size
+ * @param pool the pool to allocate from, or NULL for the heap
+ * @param objects array of POOL_OBJECTS object pointers
+ * @param elapsed_ns set to the elapsed time in ns
+ * @return true if every allocation succeeded
+ */
+static bool pool_churn(size_t size, MMPool *pool, void **objects, uint64_t *elapsed_ns) {
+	unsigned rnd = 2463534242u;
+	memset(objects, 0, POOL_OBJECTS * sizeof(void*));
+	uint64_t t = now_ns();
+	for (int i = 0; i < POOL_OBJECTS; i++) {
+		objects[i] = (pool != NULL) ? mm_pool_alloc(pool) : mm_malloc(size);
+		if (objects[i] == NULL) {
+			pool_release(pool, objects);
+			return false;
+		}
+		memset(objects[i], i & 0xFF, size);
+	}
+	for (int round = 0; round < POOL_ROUNDS; round++) {
+		for (int n = 0; n < POOL_OBJECTS/2; n++) {
+			rnd ^= rnd << 13; rnd ^= rnd >> 17; rnd ^= rnd << 5;
+			int i = rnd % POOL_OBJECTS;
+			if (objects[i] != NULL) {
+				if (pool != NULL) mm_pool_free(pool, objects[i]); else mm_free(objects[i]);
+				objects[i] = NULL;
+			}
+		}
+		for (int i = 0; i < POOL_OBJECTS; i++) {
+			if (objects[i] == NULL) {
+				objects[i] = (pool != NULL) ? mm_pool_alloc(pool) : mm_malloc(size);
+				if (objects[i] == NULL) {
+					pool_release(pool, objects);
+					return false;
+				}
+				memset(objects[i], i & 0xFF, size);
+			}
+		}
+	}
+	pool_release(pool, objects);
+	*elapsed_ns = now_ns() - t;
+	return true;
+}
+
+/**
+ * Compare a pool of objects of one size against mm_malloc and mm_free.
+ * @param size the object size
+ * @return true if both ran without running out of memory
+ */
+static bool pool_benchmark(size_t size) {
+	void **objects = malloc(POOL_OBJECTS * sizeof(void*));
+	const char *names[] = { "malloc", "pool" };
+	bool ok = (objects != NULL);
+
+	fprintf(stderr, "Pool benchmark, %d objects of %zu bytes\n", POOL_OBJECTS, size);
+	fprintf(stderr, "%8s%10s%8s%10s\n", "heap", "secs", "Kops", "heapKB");
+	for (int use_pool = 0; ok && use_pool < 2; use_pool++) {
+		MMPool *pool = NULL;
+		if (use_pool && (pool = mm_pool_create(size, 0)) == NULL) {
+			fprintf(stderr, "Pool not available\n");
+			break;
+		}
+		uint64_t elapsed_ns = 0;
+		bool churned = pool_churn(size, pool, objects, &elapsed_ns);
+		size_t heapsize = mem_heapsize();
+		mm_pool_destroy(pool);
+		mm_reset();
+		if (!churned) {
+			fprintf(stderr, "%8s out of memory\n", names[use_pool]);
+			ok = false;
+			break;
+		}
+
+		/* ops counted the same way for both: first fill, churn, and final free */
+		double secs = elapsed_ns / 1e9;
+		double ops = 2.0 * POOL_OBJECTS + 2.0 * POOL_ROUNDS * (POOL_OBJECTS/2);
+		fprintf(stderr, "%8s%10.6f%8d%10zu\n",
+				names[use_pool], secs, (int)(ops/1e3/secs), heapsize/1024);
+	}
+	free(objects);
+	return ok;
+}
+
+/**
+ * Get the bytes of the heap in use: neither free nor parked for reuse.
+ * @return the bytes in use
+ */
+static size_t heap_in_use(void) {
+	return mem_heapsize() - mm_getfree();
+}
+
+/**
+ * Get the size of a block of a request in the region benchmark.
+ * @param rnd the random state, advanced
+ * @param i the index of the block in the request
+ * @return the size
+ */
+static size_t request_block_size(unsigned *rnd, int i) {
+	*rnd ^= *rnd << 13; *rnd ^= *rnd >> 17; *rnd ^= *rnd << 5;
+	return (i % REQUEST_BIG_EVERY == REQUEST_BIG_EVERY - 1) ? REQUEST_BIG_BLOCK : 1 + *rnd % REQUEST_MAX_BLOCK;
+}
+
+/**
+ * Allocate the blocks of a request from a region, or from the heap if
+ * there is no region, and fill each with its index.
+ * @param region the region, or NULL for the heap
+ * @param blocks set to the blocks, from index first
+ * @param sizes set to their sizes
+ * @param first the index of the first block
+ * @param n the index after the last block
+ * @param rnd the random state, advanced
+ * @return true if every block was allocated; the blocks not allocated are NULL
+ */
+static bool request_alloc(MMRegion *region, void **blocks, size_t *sizes, int first, int n, unsigned *rnd) {
+	for (int i = first; i < n; i++) {
+		sizes[i] = request_block_size(rnd, i);
+		blocks[i] = (region != NULL) ? mm_region_alloc(region, sizes[i]) : mm_malloc(sizes[i]);
+		if (blocks[i] == NULL) {
+			while (++i < n) blocks[i] = NULL;
+			return false;
+		}
+		memset(blocks[i], i & 0xFF, sizes[i]);
+	}
+	return true;
+}
+
+/**
+ * Check that the blocks of a request still hold their fill, so that none overlap.
+ * @param blocks the blocks
+ * @param sizes their sizes
+ * @param n the number of blocks
+ * @return true if every block holds its fill at both ends
+ */
+static bool request_check(void **blocks, size_t *sizes, int n) {
+	for (int i = 0; i < n; i++) {
+		const unsigned char *b = blocks[i];
+		if (b[0] != (i & 0xFF) || b[sizes[i]-1] != (i & 0xFF)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Free the blocks of a request allocated from the heap.
+ * @param blocks the blocks, NULL where not allocated
+ * @param n the number of blocks
+ */
+static void request_free(void **blocks, int n) {
+	for (int i = 0; i < n; i++) {
+		mm_free(blocks[i]);
+	}
+}
+
+/**
+ * Serve requests whose blocks all die at the end of the request, either
+ * from a region marked at the start of each request and released at its
+ * end, or from the heap with a free per block. Each request also releases
+ * a nested set of blocks half way through.
+ * @param requests the number of requests
+ * @param use_region true to allocate from a region
+ * @param elapsed_ns set to the elapsed time in ns
+ * @param heapsize set to the heap size after the requests
+ * @return true if every block was allocated and kept its contents, and
+ *   the heap in use is back where it started once the region is destroyed
+ */
+static bool request_churn(int requests, bool use_region, uint64_t *elapsed_ns, size_t *heapsize) {
+	void *blocks[REQUEST_BLOCKS], *nested[REQUEST_NESTED];
+	size_t sizes[REQUEST_BLOCKS], nested_sizes[REQUEST_NESTED];
+	unsigned rnd = 2463534242u;
+	size_t in_use = heap_in_use();
+	bool ok = true;
+
+	uint64_t t = now_ns();
+	MMRegion *region = use_region ? mm_region_create(0) : NULL;
+	if (use_region && region == NULL) {
+		return false;
+	}
+	for (int req = 0; ok && req < requests; req++) {
+		MMRegionMark start = use_region ? mm_region_mark(region) : (MMRegionMark){ NULL, NULL };
+		ok = request_alloc(region, blocks, sizes, 0, REQUEST_BLOCKS/2, &rnd);
+		if (ok) {
+			MMRegionMark inner = use_region ? mm_region_mark(region) : (MMRegionMark){ NULL, NULL };
+			ok = request_alloc(region, nested, nested_sizes, 0, REQUEST_NESTED, &rnd)
+					&& request_check(nested, nested_sizes, REQUEST_NESTED);
+			if (use_region) mm_region_release(region, inner); else request_free(nested, REQUEST_NESTED);
+		}
+		ok = ok && request_alloc(region, blocks, sizes, REQUEST_BLOCKS/2, REQUEST_BLOCKS, &rnd);
+		ok = ok && request_check(blocks, sizes, REQUEST_BLOCKS);
+		if (use_region) mm_region_release(region, start); else request_free(blocks, REQUEST_BLOCKS);
+	}
+	*heapsize = mem_heapsize();
+	mm_region_destroy(region);
+	*elapsed_ns = now_ns() - t;
+	return ok && heap_in_use() == in_use;
+}
+
+/**
+ * Compare a region, marked and released per request, against mm_malloc
+ * and mm_free for blocks that die together.
+ * @param requests the number of requests
+ * @return true if both ran correctly and gave back all their memory
+ */
+static bool region_benchmark(int requests) {
+	const char *names[] = { "malloc", "region" };
+	bool ok = true;
+
+	fprintf(stderr, "Region benchmark, %d requests of %d blocks\n", requests, REQUEST_BLOCKS + REQUEST_NESTED);
+	fprintf(stderr, "%8s%10s%8s%10s\n", "heap", "secs", "Kops", "heapKB");
+	for (int use_region = 0; use_region < 2; use_region++) {
+		uint64_t elapsed_ns = 0;
+		size_t heapsize = 0;
+		if (!request_churn(requests, use_region, &elapsed_ns, &heapsize)) {
+			fprintf(stderr, "%8s failed: out of memory, a block was overwritten, or memory was not given back\n",
+					names[use_region]);
+			ok = false;
+		} else {
+			/* ops counted the same way for both: an allocation and a free per block */
+			double secs = elapsed_ns / 1e9;
+			double ops = 2.0 * requests * (REQUEST_BLOCKS + REQUEST_NESTED);
+			fprintf(stderr, "%8s%10.6f%8d%10zu\n",
+					names[use_region], secs, (int)(ops/1e3/secs), heapsize/1024);
+		}
+		mm_reset();
+	}
+	return ok;
+}
+
+/**
+ * Allocate blocks of one size until the heap is out of memory, and check
+ * that it then lacks room for another block, allowing a page for the
+ * granularity in which the heap grows.
+ * @param size the block size
+ * @return true if the heap filled up to its maximum size
+ */
+static bool fill_test(size_t size) {
+	size_t count = 0, capacity = 1024;
+	void **blocks = malloc(capacity * sizeof(void*));
+	if (blocks == NULL) {
+		return false;
+	}
+	void *p;
+	errno = 0;
+	while ((p = mm_malloc(size)) != NULL) {
+		if (count == capacity) {
+			void **more = realloc(blocks, 2 * capacity * sizeof(void*));
+			if (more == NULL) {
+				mm_free(p);
+				break;
+			}
+			blocks = more;
+			capacity *= 2;
+		}
+		blocks[count++] = p;
+	}
+	bool out_of_memory = (p == NULL && errno == ENOMEM);
+	size_t heapsize = mem_heapsize();
+	size_t left = mem_max_heap() - heapsize;
+	bool filled = out_of_memory && left < size + mem_pagesize();
+
+	fprintf(stderr, "Fill test, %zu byte blocks: %zu blocks, heap %zuKB of %zuKB, %zu bytes left%s\n",
+			size, count, heapsize/1024, mem_max_heap()/1024, left,
+			filled ? "" : (out_of_memory ? ", room for another block" : ", stopped before the heap was full"));
+	for (size_t i = 0; i < count; i++) {
+		mm_free(blocks[i]);
+	}
+	free(blocks);
+	mm_reset();
+	return filled;
+}
+
+/**
+ * Print the counters of each trace per op, by op type and for all ops.
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @param counters the counters
+ */
+static void print_op_counters(TraceInfo *results, int ntraces, PerfCounters *counters) {
+	int cycles = perf_counters_find(counters, "cycles");
+	int instrs = perf_counters_find(counters, "instructions");
+
+	fprintf(stderr, "\nCounts per op%s:\n",
+			counters->multiplexed ? " (scaled, counters were multiplexed)" : "");
+	fprintf(stderr, "%5s%9s%11s", "index", "op", "ops");
+	for (int c = 0; c < counters->ncounters; c++) {
+		if (perf_counters_available(counters, c)) fprintf(stderr, "%9s", counter_labels[c]);
+	}
+	if (cycles >= 0 && instrs >= 0) fprintf(stderr, "%7s", "IPC");
+	fprintf(stderr, "\n");
+
+	for (int i = 0; i < ntraces; i++) {
+		if (results[i].ops == 0) {
+			continue;
+		}
+		/* one row per op type, then one row for all ops */
+		for (int op = 0; op <= NOPTYPES; op++) {
+			uint64_t ops = 0;
+			uint64_t counts[PERF_MAX_COUNTERS] = { 0 };
+			for (int t = 0; t < NOPTYPES; t++) {
+				if (op == NOPTYPES || op == t) {
+					ops += results[i].opcounts[t];
+					for (int c = 0; c < counters->ncounters; c++) {
+						counts[c] += results[i].counts[t][c];
+					}
+				}
+			}
+			if (ops == 0) {
+				continue;
+			}
+			fprintf(stderr, "%5d%9s%11llu", i+1, (op == NOPTYPES) ? "all" : op_names[op], (unsigned long long)ops);
+			for (int c = 0; c < counters->ncounters; c++) {
+				if (perf_counters_available(counters, c)) fprintf(stderr, "%9.2f", (double)counts[c]/ops);
+			}
+			if (cycles >= 0 && instrs >= 0) {
+				fprintf(stderr, "%7.2f", counts[cycles] ? (double)counts[instrs]/counts[cycles] : 0.0);
+			}
+			fprintf(stderr, "\n");
+		}
+	}
+}
+
+/**
+ * Print the throughput statistics of the timed replays of each trace and the
+ * latency percentiles of its sampled replay.
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @param reps the timed replays of each trace
+ * @param warmups the warm-up replays of each trace
+ */
+static void print_run_stats(TraceInfo *results, int ntraces, int reps, int warmups) {
+	fprintf(stderr, "\nStatistics of %d timed replays after %d warm-up replays, latencies of one sampled replay"
+			" less %llu ns of timer overhead:\n", reps, warmups, (unsigned long long)timer_overhead_ns);
+	fprintf(stderr, "%5s%9s%9s%9s%9s%9s%9s%9s%9s", "index",
+			"Kops", "minKops", "sdKops", "ci95", "ns/op", "min", "sd", "ci95");
+	for (size_t p = 0; p < NPERCENTILES; p++) {
+		fprintf(stderr, "%8s", percentile_labels[p]);
+	}
+	fprintf(stderr, "%10s\n", "maxns");
+
+	for (int i = 0; i < ntraces; i++) {
+		if (results[i].ops == 0) {
+			continue;
+		}
+		const SampleStats *k = &results[i].kops;
+		const SampleStats *n = &results[i].nsop;
+		fprintf(stderr, "%5d%9.0f%9.0f%9.1f%9.1f%9.1f%9.1f%9.2f%9.2f", i+1,
+				k->median, k->min, k->stddev, k->ci95, n->median, n->min, n->stddev, n->ci95);
+		for (size_t p = 0; p < NPERCENTILES; p++) {
+			fprintf(stderr, "%8llu", (unsigned long long)latency_percentile(&results[i].latency, latency_percentiles[p]));
+		}
+		fprintf(stderr, "%10llu\n", (unsigned long long)results[i].latency.max);
+	}
+}
+
+/**
+ * Print the peak heap of each trace with and without lifetime placement.
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @param lifetime what lifetimes were predicted from
+ */
+static void print_lifetime_results(TraceInfo *results, int ntraces, MMLifetimeMode lifetime) {
+	fprintf(stderr, "\nPeak heap with blocks placed by lifetime predicted from %s:\n", lifetime_names[lifetime]);
+	fprintf(stderr, "%5s%10s%7s%10s%7s%9s%9s\n", "index", "heapKB", "util%", "lifeKB", "util%", "change%", "errors");
+	size_t heap = 0;
+	size_t lifeheap = 0;
+	for (int i = 0; i < ntraces; i++) {
+		if (results[i].ops == 0 || results[i].lifeheap == 0) {
+			continue;
+		}
+		const TraceInfo *r = &results[i];
+		fprintf(stderr, "%5d%10zu%7.1f%10zu%7.1f%9.1f%9llu\n", i+1,
+				r->heapsize/1024, r->heapsize ? 100.0*r->peaklive/r->heapsize : 0.0,
+				r->lifeheap/1024, 100.0*r->peaklive/r->lifeheap,
+				r->heapsize ? 100.0*((double)r->lifeheap - r->heapsize)/r->heapsize : 0.0,
+				(unsigned long long)r->lifeerrors);
+		heap += r->heapsize;
+		lifeheap += r->lifeheap;
+	}
+	fprintf(stderr, "%5s%10zu%7s%10zu%7s%9.1f\n", "total", heap/1024, "", lifeheap/1024, "",
+			heap ? 100.0*((double)lifeheap - heap)/heap : 0.0);
+}
+
+/**
+ * Write a string as a quoted JSON or CSV string.
+ * @param out the output
+ * @param str the string
+ * @param csv quote for CSV rather than JSON
+ */
+static void write_string(FILE *out, const char *str, bool csv) {
+	fputc('"', out);
+	for (; *str != '\0'; str++) {
+		if (*str == '"') {
+			fputs(csv ? "\"\"" : "\\\"", out);
+		} else if (*str == '\\' && !csv) {
+			fputs("\\\\", out);
+		} else if ((unsigned char)*str < ' ' && !csv) {
+			fprintf(out, "\\u%04x", *str);
+		} else {
+			fputc(*str, out);
+		}
+	}
+	fputc('"', out);
+}
+
+/**
+ * Write a summary of samples as a JSON object.
+ * @param out the output
+ * @param name the key of the object
+ * @param stats the summary
+ */
+static void write_json_stats(FILE *out, const char *name, const SampleStats *stats) {
+	fprintf(out, "\"%s\": {\"median\": %g, \"min\": %g, \"max\": %g, \"mean\": %g, \"stddev\": %g, \"ci95\": %g}",
+			name, stats->median, stats->min, stats->max, stats->mean, stats->stddev, stats->ci95);
+}
+
+/**
+ * Write the results of each trace as JSON or CSV.
+ * @param out the output
+ * @param csv write CSV rather than JSON
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @param reps the timed replays of each trace
+ * @param warmups the warm-up replays of each trace
+ * @param counters the counters, or NULL if none were counted
+ * @param remote write the throughput of the remote NUMA node replays
+ */
+static void write_results(FILE *out, bool csv, TraceInfo *results, int ntraces, int reps, int warmups,
+		PerfCounters *counters, bool remote) {
+	const char *stat_names[] = { "median", "min", "max", "mean", "stddev", "ci95" };
+	if (csv) {
+		fprintf(out, "index,file,ops,leaks,errors,reps,warmups,secs,copied_bytes,heap_bytes,peak_live_bytes,utilization");
+		for (int s = 0; s < 6; s++) fprintf(out, ",kops_%s", stat_names[s]);
+		for (int s = 0; s < 6; s++) fprintf(out, ",nsop_%s", stat_names[s]);
+		for (size_t p = 0; p < NPERCENTILES; p++) fprintf(out, ",latency_%s_ns", percentile_labels[p]);
+		fprintf(out, ",latency_max_ns");
+		if (remote) fprintf(out, ",remote_kops");
+		for (int c = 0; counters != NULL && c < counters->ncounters; c++) {
+			if (perf_counters_available(counters, c)) fprintf(out, ",%s", counters->names[c]);
+		}
+		fprintf(out, "\n");
+	} else {
+		fprintf(out, "{\n  \"reps\": %d,\n  \"warmups\": %d,\n  \"traces\": [", reps, warmups);
+	}
+
+	const char *separator = "";
+	for (int i = 0; i < ntraces; i++) {
+		TraceInfo *r = &results[i];
+		if (r->ops == 0) {
+			continue;
+		}
+		double remotekops = (r->remotesecs > 0) ? r->ops/1e3/r->remotesecs : 0;
+		double utilization = (r->heapsize > 0) ? (double)r->peaklive / r->heapsize : 0;
+		if (csv) {
+			fprintf(out, "%d,", i+1);
+			write_string(out, r->traceName, true);
+			fprintf(out, ",%llu,%llu,%llu,%d,%d,%g,%zu,%zu,%zu,%g", (unsigned long long)r->ops,
+					(unsigned long long)r->leaks, (unsigned long long)r->errors, reps, warmups, r->secs, r->copied,
+					r->heapsize, r->peaklive, utilization);
+			for (int k = 0; k < 2; k++) {
+				const SampleStats *st = (k == 0) ? &r->kops : &r->nsop;
+				fprintf(out, ",%g,%g,%g,%g,%g,%g", st->median, st->min, st->max, st->mean, st->stddev, st->ci95);
+			}
+			for (size_t p = 0; p < NPERCENTILES; p++) {
+				fprintf(out, ",%llu", (unsigned long long)latency_percentile(&r->latency, latency_percentiles[p]));
+			}
+			fprintf(out, ",%llu", (unsigned long long)r->latency.max);
+			if (remote) fprintf(out, ",%g", remotekops);
+			for (int c = 0; counters != NULL && c < counters->ncounters; c++) {
+				if (perf_counters_available(counters, c)) {
+					uint64_t total = 0;
+					for (int t = 0; t < NOPTYPES; t++) total += r->counts[t][c];
+					fprintf(out, ",%llu", (unsigned long long)total);
+				}
+			}
+			fprintf(out, "\n");
+			continue;
+		}
+
+		fprintf(out, "%s\n    {\"index\": %d, \"file\": ", separator, i+1);
+		write_string(out, r->traceName, false);
+		fprintf(out, ", \"ops\": %llu, \"leaks\": %llu, \"errors\": %llu, \"secs\": %g, \"copied_bytes\": %zu,\n     ",
+				(unsigned long long)r->ops, (unsigned long long)r->leaks, (unsigned long long)r->errors,
+				r->secs, r->copied);
+		fprintf(out, "\"heap_bytes\": %zu, \"peak_live_bytes\": %zu, \"utilization\": %g,\n     ",
+				r->heapsize, r->peaklive, utilization);
+		write_json_stats(out, "kops", &r->kops);
+		fprintf(out, ",\n     ");
+		write_json_stats(out, "ns_per_op", &r->nsop);
+		fprintf(out, ",\n     \"latency_ns\": {");
+		for (size_t p = 0; p < NPERCENTILES; p++) {
+			fprintf(out, "\"%s\": %llu, ", percentile_labels[p],
+					(unsigned long long)latency_percentile(&r->latency, latency_percentiles[p]));
+		}
+		fprintf(out, "\"max\": %llu}", (unsigned long long)r->latency.max);
+		if (remote) fprintf(out, ",\n     \"remote_kops\": %g", remotekops);
+		if (counters != NULL) {
+			fprintf(out, ",\n     \"counters\": {");
+			for (int t = 0; t < NOPTYPES; t++) {
+				fprintf(out, "%s\"%s\": {\"ops\": %llu", t ? ", " : "", op_names[t],
+						(unsigned long long)r->opcounts[t]);
+				for (int c = 0; c < counters->ncounters; c++) {
+					if (perf_counters_available(counters, c)) {
+						fprintf(out, ", \"%s\": %llu", counters->names[c], (unsigned long long)r->counts[t][c]);
+					}
+				}
+				fprintf(out, "}");
+			}
+			fprintf(out, "}");
+		}
+		fprintf(out, "}");
+		separator = ",";
+	}
+	if (!csv) fprintf(out, "\n  ]\n}\n");
+}
+
+/**
+ * Find the metrics of a trace that are compared with a baseline.
+ * @param r the trace results
+ * @param metrics set to the metrics
+ */
+static void trace_metrics(const TraceInfo *r, double metrics[NMETRICS]) {
+	metrics[METRIC_KOPS] = r->kops.median;
+	metrics[METRIC_P99] = latency_percentile(&r->latency, 99);
+	metrics[METRIC_HEAP] = r->heapsize;
+	metrics[METRIC_UTIL] = (r->heapsize > 0) ? (double)r->peaklive / r->heapsize : 0;
+}
+
+/**
+ * Save the results of each trace as a baseline.
+ * @param path the baseline file
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @return true if the baseline was written
+ */
+static bool save_baseline(const char *path, TraceInfo *results, int ntraces) {
+	FILE *out = fopen(path, "w");
+	if (out == NULL) {
+		return false;
+	}
+	fprintf(out, "# test_heap baseline: kops p99ns heapbytes utilization errors file\n");
+	for (int i = 0; i < ntraces; i++) {
+		if (results[i].ops > 0) {
+			double metrics[NMETRICS];
+			trace_metrics(&results[i], metrics);
+			char name[strlen(results[i].traceName) + 1];
+			strcpy(name, results[i].traceName);
+			fprintf(out, "%.17g %.17g %.17g %.17g %llu %s\n",
+					metrics[METRIC_KOPS], metrics[METRIC_P99], metrics[METRIC_HEAP], metrics[METRIC_UTIL],
+					(unsigned long long)results[i].errors, basename(name));
+		}
+	}
+	return fclose(out) == 0;
+}
+
+/**
+ * Load a baseline saved by save_baseline.
+ * @param path the baseline file
+ * @param nentries set to the number of traces in the baseline
+ * @return the traces in the baseline, or NULL if it could not be read
+ */
+static BaselineEntry *load_baseline(const char *path, int *nentries) {
+	FILE *in = fopen(path, "r");
+	if (in == NULL) {
+		return NULL;
+	}
+	BaselineEntry *entries = NULL;
+	int n = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		BaselineEntry e;
+		unsigned long long errors;
+		int name;
+		if (line[0] == '#' || sscanf(line, "%lf %lf %lf %lf %llu %n",
+				&e.metrics[METRIC_KOPS], &e.metrics[METRIC_P99], &e.metrics[METRIC_HEAP],
+				&e.metrics[METRIC_UTIL], &errors, &name) != 5) {
+			continue;
+		}
+		line[strcspn(line, "\n")] = '\0';
+		BaselineEntry *grown = realloc(entries, (n + 1) * sizeof(BaselineEntry));
+		if (grown == NULL || (e.name = strdup(line + name)) == NULL) {
+			entries = (grown != NULL) ? grown : entries;
+			break;
+		}
+		e.errors = errors;
+		entries = grown;
+		entries[n++] = e;
+	}
+	fclose(in);
+	*nentries = n;
+	return (entries != NULL) ? entries : calloc(1, sizeof(BaselineEntry));
+}
+
+/**
+ * Find the baseline of a trace.
+ * @param entries the traces in the baseline
+ * @param nentries the number of traces in the baseline
+ * @param path the trace file
+ * @return the baseline of the trace, or NULL if it has none
+ */
+static BaselineEntry *find_baseline(BaselineEntry *entries, int nentries, const char *path) {
+	char name[strlen(path) + 1];
+	strcpy(name, path);
+	const char *base = basename(name);
+	for (int j = 0; j < nentries; j++) {
+		if (strcmp(entries[j].name, base) == 0) {
+			return &entries[j];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Find the percent change of a metric from its baseline.
+ * @param now the metric
+ * @param base the baseline of the metric
+ * @return the percent change
+ */
+static double metric_change(double now, double base) {
+	return (base != 0) ? 100 * (now - base) / base : 0;
+}
+
+/**
+ * Find whether a metric changed for the worse by more than its tolerance.
+ * @param m the metric
+ * @param change the percent change of the metric
+ * @param tolerance the percent change allowed per metric
+ * @return true if the metric regressed
+ */
+static bool metric_regressed(Metric m, double change, const double tolerance[NMETRICS]) {
+	return metric_higher_better[m] ? (change < -tolerance[m]) : (change > tolerance[m]);
+}
+
+/**
+ * Compare the results of each trace with a baseline and print the
+ * change in each metric, marking those beyond their tolerance, then
+ * the before and after values of the metrics that regressed.
+ * @param path the baseline file
+ * @param results the trace results
+ * @param ntraces the number of traces
+ * @param tolerance the percent change allowed per metric
+ * @return the number of traces that regressed, or -1 if the baseline could not be read
+ */
+static int compare_baseline(const char *path, TraceInfo *results, int ntraces, const double tolerance[NMETRICS]) {
+	int nentries;
+	BaselineEntry *entries = load_baseline(path, &nentries);
+	if (entries == NULL) {
+		return -1;
+	}
+
+	fprintf(stderr, "\nChange from baseline %s (tolerance", path);
+	for (int m = 0; m < NMETRICS; m++) {
+		fprintf(stderr, " %s %g%%", metric_names[m], tolerance[m]);
+	}
+	fprintf(stderr, "):\n%5s", "index");
+	for (int m = 0; m < NMETRICS; m++) {
+		fprintf(stderr, "%9s%%", metric_names[m]);
+	}
+	fprintf(stderr, "%11s  %s\n", "status", "file");
+
+	int regressed = 0;
+	for (int i = 0; i < ntraces; i++) {
+		if (results[i].ops == 0) {
+			continue;
+		}
+		BaselineEntry *e = find_baseline(entries, nentries, results[i].traceName);
+		fprintf(stderr, "%5d", i+1);
+		if (e == NULL) {
+			fprintf(stderr, "%*s%11s  %s\n", 10*NMETRICS, "", "new", results[i].traceName);
+			continue;
+		}
+		double metrics[NMETRICS];
+		trace_metrics(&results[i], metrics);
+		bool worse = (results[i].errors > e->errors);
+		for (int m = 0; m < NMETRICS; m++) {
+			double change = metric_change(metrics[m], e->metrics[m]);
+			bool beyond = metric_regressed(m, change, tolerance);
+			fprintf(stderr, "%+9.1f%c", change, beyond ? '!' : ' ');
+			worse = worse || beyond;
+		}
+		fprintf(stderr, "%11s  %s\n", worse ? "REGRESSED" : "ok", results[i].traceName);
+		if (worse) {
+			regressed++;
+		}
+	}
+
+	for (int i = 0; i < ntraces; i++) {
+		BaselineEntry *e = (results[i].ops > 0) ? find_baseline(entries, nentries, results[i].traceName) : NULL;
+		if (e == NULL) {
+			continue;
+		}
+		double metrics[NMETRICS];
+		trace_metrics(&results[i], metrics);
+		for (int m = 0; m < NMETRICS; m++) {
+			double change = metric_change(metrics[m], e->metrics[m]);
+			if (metric_regressed(m, change, tolerance)) {
+				fprintf(stderr, "  %s: %s %.*f -> %.*f (%+.1f%%, tolerance %g%%)\n", e->name, metric_names[m],
+						metric_decimals[m], e->metrics[m], metric_decimals[m], metrics[m], change, tolerance[m]);
+			}
+		}
+		if (results[i].errors > e->errors) {
+			fprintf(stderr, "  %s: errors %llu -> %llu\n", e->name,
+					(unsigned long long)e->errors, (unsigned long long)results[i].errors);
+		}
+	}
+
+	for (int j = 0; j < nentries; j++) {
+		free(entries[j].name);
+	}
+	free(entries);
+	return regressed;
+}
+
+/**
+ * Parse per-metric tolerances such as "kops=5,p99=10".
+ * @param spec the tolerances, modified while parsed
+ * @param tolerance set to the tolerances given
+ * @return true if every tolerance names a metric
+ */
+static bool parse_tolerances(char *spec, double tolerance[NMETRICS]) {
+	for (char *item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+		char *value = strchr(item, '=');
+		if (value == NULL) {
+			return false;
+		}
+		*value++ = '\0';
+		int m;
+		for (m = 0; m < NMETRICS && strcmp(item, metric_names[m]) != 0; m++)
+			;
+		if (m == NMETRICS) {
+			return false;
+		}
+		tolerance[m] = strtod(value, NULL);
+	}
+	return true;
+}
+
+/**
+ * Parse a size in bytes with an optional K, M or G suffix, such as "8G".
+ * @param spec the size
+ * @param bytes set to the size
+ * @return true if the size is a positive number with at most a suffix
+ */
+static bool parse_bytes(const char *spec, size_t *bytes) {
+	char *end;
+	unsigned long long n = strtoull(spec, &end, 10);
+	int shift = 0;
+	switch (*end) {
+	case 'G': case 'g': shift = 30; end++; break;
+	case 'M': case 'm': shift = 20; end++; break;
+	case 'K': case 'k': shift = 10; end++; break;
+	}
+	if (n == 0 || *end != '\0' || n > (SIZE_MAX >> shift)) {
+		return false;
+	}
+	*bytes = (size_t)n << shift;
+	return true;
+}
+
 /**
  * Program processes trace files.
  * @param argc the argument count
@@ -44,11 +1382,134 @@ int main(int argc, char *argv[]) {
 	char c;
 	bool verbose = false;
 	bool debug = false;
-    while ((c = getopt(argc, argv, "dhv")) != EOF) {
+	bool hugepages = false;
+	bool tlb = false;
+	bool cpu = false;
+	bool numa = false;
+	char *pprof_file = NULL;
+	char *folded_file = NULL;
+	size_t profile_interval = PROFILE_INTERVAL;
+	size_t pool_size = 0;
+	size_t fill_size = 0;
+	int region_requests = 0;
+	char *snapshot_file = NULL;
+	int snapshot_ops = SNAPSHOT_OPS;
+	VerifyMode verify = VERIFY_FULL;
+	MMLifetimeMode lifetime = MM_LIFETIME_OFF;
+	int warmups = 0;
+	int reps = 1;
+	int cpu_pin = -1;
+	char *results_file = NULL;
+	char *save_file = NULL;
+	char *baseline_file = NULL;
+	size_t max_heap = 0;
+	double tolerance[NMETRICS];
+	memcpy(tolerance, metric_tolerance, sizeof(tolerance));
+    while ((c = getopt(argc, argv, "dhvHtcNp:F:S:P:R:E:m:M:V:L:w:r:C:o:b:B:T:X:")) != EOF) {
         switch (c) {
         case 'd':
         	debug = true;
         	break;
+        case 'H': /* Back the heap with huge pages */
+        	hugepages = true;
+        	break;
+        case 't': /* Count dTLB misses in the heap calls */
+        	tlb = true;
+        	break;
+        case 'c': /* Count cycles, cache, and branch misses per op type */
+        	cpu = true;
+        	break;
+        case 'N': /* Compare local and remote NUMA node allocation */
+        	numa = true;
+        	break;
+        case 'p': /* Write a pprof heap profile */
+        	pprof_file = optarg;
+        	break;
+        case 'F': /* Write folded stacks */
+        	folded_file = optarg;
+        	break;
+        case 'S': /* Mean bytes between profile samples */
+        	profile_interval = strtoul(optarg, NULL, 10);
+        	break;
+        case 'P': /* Benchmark a pool of objects */
+        	pool_size = strtoul(optarg, NULL, 10);
+        	break;
+        case 'R': /* Benchmark a region per request */
+        	region_requests = atoi(optarg);
+        	break;
+        case 'E': /* Fill the heap to its limit */
+        	fill_size = strtoul(optarg, NULL, 10);
+        	break;
+        case 'm': /* Append heap snapshots */
+        	snapshot_file = optarg;
+        	break;
+        case 'M': /* Ops between heap snapshots */
+        	snapshot_ops = atoi(optarg);
+        	if (snapshot_ops <= 0) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'V': /* Payload verification mode */
+        	for (verify = VERIFY_FULL; verify <= VERIFY_OFF; verify++) {
+        		if (strcmp(optarg, verify_names[verify]) == 0) {
+        			break;
+        		}
+        	}
+        	if (verify > VERIFY_OFF) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'L': /* Lifetime placement to compare */
+        	for (lifetime = MM_LIFETIME_SIZES; lifetime <= MM_LIFETIME_SITES; lifetime++) {
+        		if (strcmp(optarg, lifetime_names[lifetime]) == 0) {
+        			break;
+        		}
+        	}
+        	if (lifetime > MM_LIFETIME_SITES) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'w': /* Warm-up replays */
+        	warmups = atoi(optarg);
+        	if (warmups < 0) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'r': /* Timed replays */
+        	reps = atoi(optarg);
+        	if (reps <= 0) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'C': /* Pin to a CPU */
+        	cpu_pin = atoi(optarg);
+        	break;
+        case 'o': /* Write the results */
+        	results_file = optarg;
+        	break;
+        case 'b': /* Save a baseline */
+        	save_file = optarg;
+        	break;
+        case 'B': /* Compare with a baseline */
+        	baseline_file = optarg;
+        	break;
+        case 'T': /* Tolerances of the baseline metrics */
+        	if (!parse_tolerances(optarg, tolerance)) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
+        case 'X': /* Maximum heap size */
+        	if (!parse_bytes(optarg, &max_heap)) {
+        		usage();
+        		return EXIT_FAILURE;
+        	}
+        	break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = true;
             break;
@@ -62,206 +1523,259 @@ int main(int argc, char *argv[]) {
     }
 
     // ensure trace files specified
-    if (optind == argc) {
+    if (optind == argc && pool_size == 0 && region_requests <= 0 && fill_size == 0) {
     	fprintf(stderr, "one or more trace files required.\n");
     	usage();
     	return EXIT_FAILURE;
     }
 
-    // init memory model with default size
+    // pin before the heap is touched so that its pages are local to the CPU
+    if (cpu_pin >= 0) {
+    	cpu_set_t set;
+    	CPU_ZERO(&set);
+    	CPU_SET(cpu_pin, &set);
+    	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    		fprintf(stderr, "Cannot pin to CPU %d\n", cpu_pin);
+    	} else if (verbose) {
+    		fprintf(stderr, "Pinned to CPU %d\n", cpu_pin);
+    	}
+    }
+
+    // init memory model with the default or the -X size
+    mem_use_hugepages(hugepages);
+    if (max_heap > 0) {
+    	mem_set_max_heap(max_heap);
+    }
     mm_init();
+    if (hugepages || verbose) {
+    	fprintf(stderr, "Heap backed by %s, at most %zu MB\n", page_backing[mem_page_backing()], mem_max_heap() >> 20);
+    }
+
+    PerfCounters counters;
+    bool counting = tlb || cpu;
+    if (counting) {
+    	int n = cpu ? sizeof(counter_events)/sizeof(counter_events[0]) : TLB_EVENTS;
+    	if (perf_counters_open(&counters, counter_events, n) == 0) {
+    		fprintf(stderr, "Hardware counters not available\n");
+    		counting = tlb = cpu = false;
+    	}
+    }
+
+    int local_node = -1;
+    int remote_node = -1;
+    // on the main heap, whose size mem_heapsize reports, before any NUMA arenas
+    bool pooled = (pool_size == 0 || pool_benchmark(pool_size));
+    bool regioned = (region_requests <= 0 || region_benchmark(region_requests));
+    bool filled = (fill_size == 0 || fill_test(fill_size));
+    if (optind == argc) {
+    	mm_deinit();
+    	return (pooled && regioned && filled) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (numa) {
+    	int nodes = mm_numa_init();
+    	if (nodes == 0) {
+    		fprintf(stderr, "NUMA arenas not available\n");
+    		numa = false;
+    	} else {
+    		local_node = mm_numa_bind(-1);
+    		if (nodes > 1) {
+    			remote_node = (local_node + 1) % nodes;
+    		} else {
+    			fprintf(stderr, "Only one NUMA node, no remote allocation to compare\n");
+    		}
+    		if (verbose) fprintf(stderr, "Local node %d, remote node %d\n", local_node, remote_node);
+    	}
+    }
+
+    if (pprof_file != NULL || folded_file != NULL) {
+    	mm_profile_start(profile_interval);
+    }
+
+    // calibrate the clock reads around each op of the sampled replays
+    timer_overhead_ns = measure_timer_overhead();
+    if (verbose) fprintf(stderr, "Timer overhead %llu ns per op\n", (unsigned long long)timer_overhead_ns);
+
+    FILE *snapshots = NULL;
+    if (snapshot_file != NULL && (snapshots = fopen(snapshot_file, "ab")) == NULL) {
+    	fprintf(stderr, "Cannot write snapshots %s\n", snapshot_file);
+    }
 
     // allocate array for trace results
-    TraceInfo results[argc-optind];
+    TraceInfo *results = calloc(argc-optind, sizeof(TraceInfo));
+    double *kops = calloc(reps, sizeof(double));
+    double *nsop = calloc(reps, sizeof(double));
+    if (results == NULL || kops == NULL || nsop == NULL) {
+    	fprintf(stderr, "No memory for trace results\n");
+    	return EXIT_FAILURE;
+    }
 
     int traceindex = 0;
     for (int index = optind; index < argc; index++, traceindex++) {
 		results[traceindex].traceName = argv[index];
 
-		if (verbose) fprintf(stderr, "Opening trace file: %s\n", results[traceindex].traceName);
-		FILE *tracefile = fopen(results[traceindex].traceName, "r");
-		if (tracefile == NULL) {
-			results[traceindex].ops = 0;
-			if (verbose) fprintf(stderr, "Missing trace file: %s\n\n", results[traceindex].traceName);
+		// load the trace up front so that parsing is not part of the replays
+		if (verbose) fprintf(stderr, "Opening trace file: %s\n", argv[index]);
+		Trace *trace = trace_load(argv[index]);
+		if (trace == NULL) {
+			if (verbose) fprintf(stderr, "Missing trace file: %s\n\n", argv[index]);
 			continue;
 		}
 
-		int heapsize;
-		int num_ids;
-		int num_ops;
-		int weight;
-
-		fscanf(tracefile, "%d", &heapsize); /* not used */
-		fscanf(tracefile, "%d", &num_ids);
-		fscanf(tracefile, "%d", &num_ops);
-		fscanf(tracefile, "%d", &weight);        /* not used */
-
-		/* We'll keep an array of pointers to the allocated blocks here... */
-		size_t block_sizes[num_ids];
-		memset(block_sizes, 0, num_ids * sizeof(size_t));
-
-		void* blocks[num_ids];
-		memset(blocks, 0, num_ids * sizeof(void*));
-
-		/* read every request line in the trace file */
-		int index = 0;
-		int op_index = 0;
-		int max_index = num_ids-1;
-		int size;
-		char type[2];
-		bool nerrors = 0;
-		clock_t elapsed_time = 0;
-		if (debug || verbose) fprintf(stderr, "Processing trace file %s\n",
-				results[traceindex].traceName);
-
-		while (fscanf(tracefile, "%s", type) != EOF) {
-			switch(type[0]) {
-			case 'a':
-				fscanf(tracefile, "%u %u", &index, &size);
-				if (debug && verbose) fprintf(stderr, "  Allocating block %u size %u\n", index, size);
-				if (blocks[index] != NULL) {
-					if (debug) fprintf(stderr, "  Block %u already allocated\n", index);
-					nerrors++;
-				} else {
-					max_index = (index > max_index) ? index : max_index;
-					time_t t = clock();
-					blocks[index] = mm_malloc(size);
-					elapsed_time += clock()-t;
-					if (blocks[index] == NULL) {
-						if (debug) fprintf(stderr, "  Block %u not allocated\n", index);
-						nerrors++;
-					} else {
-						if (debug && verbose) fprintf(stderr, "  Allocated block %u size %u\n", index, size);
-						/*
-						 * fill range with low byte of index to make sure that the old
-						 * data was copied to the new block on realloc or free
-						 */
-						memset(blocks[index], (index & 0xFF), size);
-						block_sizes[index] = size;
-					}
-				}
-				break;
-			case 'r':
-				fscanf(tracefile, "%u %u", &index, &size);
-				if (debug && verbose) fprintf(stderr, "  Reallocating block %u size %u\n", index, size);
-				if (blocks[index] == NULL) {
-					if (debug) fprintf(stderr, "  Block %u not reallocated\n", index);
-					nerrors++;
-				} else {
-					for (int i = 0; i < block_sizes[index]; i++) {
-						if (*((char*)blocks[index]+i) != (char)(index & 0xFF)) {
-							if (debug) fprintf(stderr, "  Block %u has unexpected data before realloc.\n", index);
-							nerrors++;
-							/*
-							 * re-fill range with low byte of index to make sure that the old
-							 * data was copied to the new block on realloc or free
-							 */
-							memset(blocks[index], (index & 0xFF), block_sizes[index]);
-							break;
-						}
-					}
-					time_t t = clock();
-					void *b = mm_realloc(blocks[index], size);
-					elapsed_time += clock()-t;
-					if (b == NULL) {
-						if (debug) fprintf(stderr, "  Unable to realloc block %u to size %u\n", index, size);
-						nerrors++;
-					} else {
-						if (debug && verbose) fprintf(stderr, "  Reallocated block %u size %u\n", index, size);
-						blocks[index] = b;
-						for (int i = 0; i < block_sizes[index]; i++) {
-							if (*((char*)blocks[index]+i) != (char)(index & 0xFF)) {
-								if (debug) fprintf(stderr, "  Block %u has unexpected data after reallocation.\n", index);
-								nerrors++;
-								break;
-							}
-						}
-						/*
-						 * re-fill range with low byte of index to make sure that the old
-						 * data was copied to the new block on realloc or free
-						 */
-						memset(blocks[index], (index & 0xFF), size);
-						block_sizes[index] = size;
-					}
-				}
-				break;
-			case 'f':
-				fscanf(tracefile, "%u", &index);
-				if (blocks[index] == NULL) {
-					if (debug) fprintf(stderr, "  Block %u not allocated\n", index);
-					nerrors++;
-				} else {
-					if (debug & verbose) fprintf(stderr, "  Freeing block %u size %zu\n", index, block_sizes[index]);
-					for (int i = 0; i < block_sizes[index]; i++) {
-						if (*((char*)blocks[index]+i) != (char)(index & 0xFF)) {
-							if (debug) fprintf(stderr, "  Block %u has unexpected data before free.\n", index);
-							nerrors++;
-							break;
-						}
-					}
-					time_t t = clock();
-					mm_free(blocks[index]);
-					elapsed_time += clock()-t;
-					if (debug & verbose) fprintf(stderr, "  Freed block %u size %zu\n", index, block_sizes[index]);
-					blocks[index] = NULL;
-					block_sizes[index] = 0;
-				}
-				break;
-			default:
-				if (debug) fprintf(stderr, "Invalid type character (%c) in tracefile %s\n",
-									type[0], results[traceindex].traceName);
-				nerrors++;
+		if (numa) mm_numa_bind(local_node);
+		TraceInfo checked = results[traceindex];
+		if (verify != VERIFY_OFF) {
+			// check the payloads in a replay of its own so the timed replay measures the heap alone
+			if (!replay_trace(&checked, trace, false, debug, NULL, NULL, 0, verify, false)) {
+				trace_free(trace);
+				continue;
 			}
-
-			op_index++;
 		}
-		fclose(tracefile);
-
-		if (debug || verbose) fprintf(stderr, "Done processing trace file %s\n",
-				results[traceindex].traceName);
-
-		assert(max_index == num_ids - 1);
-		assert(num_ops == op_index);
-
-		results[traceindex].leaks = 0;
-		results[traceindex].errors = nerrors;
-
-		// tally and report leaks
-		char *newline = "\n";
-		for (int i = 0; i < num_ids; i++) {
-			if (blocks[index] != NULL) {
-				if (debug) fprintf(stderr, "%sblock %d not freed, size=%zu\n", newline, i, block_sizes[i]);
-				results[traceindex].leaks++;
-				newline = "";
+		for (int run = 0; run < warmups; run++) {
+			TraceInfo warm = results[traceindex];
+			replay_trace(&warm, trace, false, false, NULL, NULL, 0, VERIFY_OFF, false);
+		}
+		// time repeated replays as a whole, so that timing the ops does not slow them down
+		TraceInfo timed = results[traceindex];
+		int run;
+		for (run = 0; run < reps; run++) {
+			if (!replay_trace(&timed, trace, false, false, NULL, NULL, 0, VERIFY_OFF, false)) {
+				break;
 			}
+			kops[run] = (timed.secs > 0) ? timed.ops/1e3/timed.secs : 0;
+			nsop[run] = (timed.ops > 0) ? timed.secs*1e9/timed.ops : 0;
 		}
-
-		if (debug || verbose) fprintf(stderr, "Errors: %d, leaks: %d\n\n",
-				results[traceindex].errors, results[traceindex].leaks);
-
-		results[traceindex].secs = ((double) (elapsed_time)) / CLOCKS_PER_SEC;
-		results[traceindex].ops = op_index;
-
-		// reset memory model for next test
-		mm_reset();
+		// then a sampled replay times each op for the latencies, samples the counters and takes the snapshots
+		if (run == reps && !replay_trace(&results[traceindex], trace, verbose, debug && verify == VERIFY_OFF,
+				counting ? &counters : NULL, snapshots, snapshot_ops, VERIFY_OFF, true)) {
+			run = 0;
+		}
+		if (run < reps) {
+			results[traceindex].ops = 0;
+			trace_free(trace);
+			continue;
+		}
+		sample_stats(&results[traceindex].kops, kops, reps);
+		sample_stats(&results[traceindex].nsop, nsop, reps);
+		results[traceindex].secs = results[traceindex].nsop.median * results[traceindex].ops / 1e9;
+		if (verify != VERIFY_OFF) {
+			results[traceindex].errors = checked.errors;
+			results[traceindex].leaks = checked.leaks;
+		}
+		results[traceindex].remotesecs = 0;
+		if (remote_node >= 0) {
+			// replay again allocating from the arena of a remote node
+			TraceInfo remote = results[traceindex];
+			mm_numa_bind(remote_node);
+			replay_trace(&remote, trace, verbose, false, NULL, NULL, 0, VERIFY_OFF, false);
+			results[traceindex].remotesecs = remote.secs;
+		}
+		trace_free(trace);
 	}
 
+    // replay the traces again with blocks placed by lifetime, after the timed replays so that
+    // those do not go through the arenas
+    if (lifetime != MM_LIFETIME_OFF && !mm_lifetime(lifetime)) {
+    	fprintf(stderr, "Lifetime placement not available\n");
+    	lifetime = MM_LIFETIME_OFF;
+    }
+    for (int i = 0; lifetime != MM_LIFETIME_OFF && i < traceindex; i++) {
+    	Trace *trace = (results[i].ops > 0) ? trace_load(results[i].traceName) : NULL;
+    	if (trace != NULL) {
+    		TraceInfo placed = results[i];
+    		replay_trace(&placed, trace, verbose, false, NULL, NULL, 0, verify, false);
+    		results[i].lifeheap = placed.heapsize;
+    		results[i].lifeerrors = placed.errors;
+    		trace_free(trace);
+    	}
+    }
+    if (lifetime != MM_LIFETIME_OFF) mm_lifetime(MM_LIFETIME_OFF);
+
 
     /* Print the individual results for each trace */
     if (verbose) fprintf(stderr, "\nResults for traces:\n");
-	fprintf(stderr, "%5s%7s%7s%8s%10s%8s  %s\n",
-	   "index", "leaks", "errors", "ops", "secs", "Kops", "file");
+	fprintf(stderr, "%5s%9s%9s%11s%10s%8s%10s%10s%7s",
+	   "index", "leaks", "errors", "ops", "secs", "Kops", "copiedKB", "heapKB", "util%");
+	if (tlb) fprintf(stderr, "%10s%9s", "dTLBmiss", "miss/op");
+	if (remote_node >= 0) fprintf(stderr, "%8s", "remKops");
+	fprintf(stderr, "  %s\n", "file");
 
     for (int i = 0; i < traceindex; i++) {
     	if (results[i].ops > 0) {
-			fprintf(stderr, "%5d%7d%7d%8d%10.6f%8d  %s\n",
-					i+1, results[i].leaks, results[i].errors, results[i].ops, results[i].secs,
-					(int)(results[i].ops/1e3/results[i].secs), results[i].traceName);
+			fprintf(stderr, "%5d%9llu%9llu%11llu%10.6f%8d%10zu",
+					i+1, (unsigned long long)results[i].leaks, (unsigned long long)results[i].errors,
+					(unsigned long long)results[i].ops, results[i].secs,
+					(int)results[i].kops.median, results[i].copied/1024);
+			fprintf(stderr, "%10zu%7.1f", results[i].heapsize/1024,
+					results[i].heapsize ? 100.0*results[i].peaklive/results[i].heapsize : 0.0);
+			if (tlb) fprintf(stderr, "%10llu%9.3f", (unsigned long long)results[i].tlbmisses,
+					(double)results[i].tlbmisses/results[i].ops);
+			if (remote_node >= 0) fprintf(stderr, "%8d", (int)(results[i].ops/1e3/results[i].remotesecs));
+			fprintf(stderr, "  %s\n", results[i].traceName);
+    	}
+    }
+
+    if (lifetime != MM_LIFETIME_OFF) print_lifetime_results(results, traceindex, lifetime);
+    if (snapshots != NULL) fclose(snapshots);
+    if (cpu) print_op_counters(results, traceindex, &counters);
+    if (reps > 1 || verbose) print_run_stats(results, traceindex, reps, warmups);
+    if (results_file != NULL) {
+    	FILE *out = fopen(results_file, "w");
+    	if (out == NULL) {
+    		fprintf(stderr, "Cannot write results %s\n", results_file);
+    	} else {
+    		size_t len = strlen(results_file);
+    		bool csv = (len >= 4 && strcmp(results_file + len - 4, ".csv") == 0);
+    		write_results(out, csv, results, traceindex, reps, warmups,
+    				counting ? &counters : NULL, remote_node >= 0);
+    		fclose(out);
+    	}
+    }
+    int status = (pooled && regioned && filled) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (save_file != NULL && !save_baseline(save_file, results, traceindex)) {
+    	fprintf(stderr, "Cannot write baseline %s\n", save_file);
+    	status = EXIT_FAILURE;
+    }
+    if (baseline_file != NULL) {
+    	int regressed = compare_baseline(baseline_file, results, traceindex, tolerance);
+    	if (regressed < 0) {
+    		fprintf(stderr, "Cannot read baseline %s\n", baseline_file);
+    		status = EXIT_FAILURE;
+    	} else if (regressed > 0) {
+    		fprintf(stderr, "%d of the traces regressed\n", regressed);
+    		status = EXIT_FAILURE;
+    	}
+    }
+    if (counting) perf_counters_close(&counters);
+    free(results);
+    free(kops);
+    free(nsop);
+
+    // write the sampled allocation profiles
+    mm_profile_stop();
+    if (pprof_file != NULL) {
+    	FILE *out = fopen(pprof_file, "w");
+    	if (out == NULL) {
+    		fprintf(stderr, "Cannot write profile %s\n", pprof_file);
+    	} else {
+    		int n = mm_profile_dump(out, MM_PROFILE_PPROF);
+    		fclose(out);
+    		if (verbose) fprintf(stderr, "Wrote %d stacks to %s\n", n, pprof_file);
+    	}
+    }
+    if (folded_file != NULL) {
+    	FILE *out = fopen(folded_file, "w");
+    	if (out == NULL) {
+    		fprintf(stderr, "Cannot write profile %s\n", folded_file);
+    	} else {
+    		int n = mm_profile_dump(out, MM_PROFILE_FOLDED_ALLOCATED);
+    		fclose(out);
+    		if (verbose) fprintf(stderr, "Wrote %d stacks to %s\n", n, folded_file);
     	}
     }
 
     // deinitialize memory model
     mm_deinit();
 
-    return EXIT_SUCCESS;
+    return status;
 }
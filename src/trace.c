@@ -0,0 +1,289 @@
+/*
+ * trace.c - heap request traces, loaded into memory before they are
+ *           replayed so that parsing is not part of the replay.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/** Ops allocated for a trace whose header gives none */
+#define TRACE_MIN_OPS 1024
+
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "binary traces store sizes as size_t");
+
+/** A position in a mapped trace file */
+typedef struct {
+	const char *p;          /* next character */
+	const char *end;        /* end of the file */
+} Cursor;
+
+/**
+ * Skip white space.
+ * @param c the position
+ * @return true if there is a token after the white space
+ */
+static bool skip_space(Cursor *c) {
+	while (c->p < c->end && isspace((unsigned char)*c->p)) {
+		c->p++;
+	}
+	return c->p < c->end;
+}
+
+/**
+ * Read an unsigned decimal number.
+ * @param c the position
+ * @param value set to the number
+ * @return true if there was a number
+ */
+static bool read_number(Cursor *c, uint64_t *value) {
+	if (!skip_space(c) || !isdigit((unsigned char)*c->p)) {
+		return false;
+	}
+	uint64_t n = 0;
+	while (c->p < c->end && isdigit((unsigned char)*c->p)) {
+		n = n*10 + (*c->p++ - '0');
+	}
+	*value = n;
+	return true;
+}
+
+/**
+ * Allocate room for ops.
+ * @param trace the trace
+ * @param n the ops to make room for, at least the ops in the trace
+ * @return true if there is room
+ */
+static bool resize_ops(Trace *trace, size_t n) {
+	char *types = realloc(trace->types, n * sizeof(*types));
+	if (types != NULL) trace->types = types;
+	uint32_t *ids = realloc(trace->ids, n * sizeof(*ids));
+	if (ids != NULL) trace->ids = ids;
+	size_t *sizes = realloc(trace->sizes, n * sizeof(*sizes));
+	if (sizes != NULL) trace->sizes = sizes;
+	return types != NULL && ids != NULL && sizes != NULL;
+}
+
+/**
+ * Parse the ops of a trace file.
+ * @param trace the trace, with the header fields set
+ * @param c the position after the header
+ * @param capacity the ops allocated
+ * @return 0 if successful, otherwise an errno value
+ */
+static int parse_ops(Trace *trace, Cursor *c, size_t capacity) {
+	while (skip_space(c)) {
+		if (trace->num_ops == capacity) {
+			capacity = (capacity < TRACE_MIN_OPS) ? TRACE_MIN_OPS : 2*capacity;
+			if (!resize_ops(trace, capacity)) {
+				return ENOMEM;
+			}
+		}
+		char type = *c->p;
+		while (c->p < c->end && !isspace((unsigned char)*c->p)) {
+			c->p++;
+		}
+		uint64_t id = 0;
+		uint64_t size = 0;
+		switch (type) {
+		case TRACE_ALLOC:
+		case TRACE_REALLOC:
+			if (!read_number(c, &id) || !read_number(c, &size)) {
+				return EINVAL;
+			}
+			break;
+		case TRACE_FREE:
+			if (!read_number(c, &id)) {
+				return EINVAL;
+			}
+			break;
+		default:
+			/* kept so that the replay reports it; skip the rest of the line */
+			while (c->p < c->end && *c->p != '\n') {
+				c->p++;
+			}
+		}
+		if (id >= UINT32_MAX || size > SIZE_MAX) {
+			return EINVAL;
+		}
+		trace->types[trace->num_ops] = type;
+		trace->ids[trace->num_ops] = id;
+		trace->sizes[trace->num_ops] = size;
+		trace->num_ops++;
+		if (id >= trace->num_ids) {
+			trace->num_ids = id + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Copy the ops of a binary trace.
+ * @param trace the trace
+ * @param data the file, starting with its TraceHeader
+ * @param len the bytes in the file
+ * @return 0 if successful, otherwise an errno value
+ */
+static int load_binary(Trace *trace, const char *data, size_t len) {
+	TraceHeader header;
+	memcpy(&header, data, sizeof(header));
+	size_t room = (len - sizeof(header)) / (sizeof(size_t) + sizeof(uint32_t) + sizeof(char));
+	if (header.num_ops > room || header.num_ids > UINT32_MAX) {
+		return EINVAL;
+	}
+	trace->heapsize = header.heapsize;
+	trace->weight = header.weight;
+	trace->header_ids = trace->num_ids = header.num_ids;
+	trace->header_ops = trace->num_ops = header.num_ops;
+	if (header.num_ops == 0) {
+		return 0;
+	}
+	if (!resize_ops(trace, header.num_ops)) {
+		return ENOMEM;
+	}
+	const char *p = data + sizeof(header);
+	memcpy(trace->sizes, p, header.num_ops * sizeof(size_t));
+	p += header.num_ops * sizeof(size_t);
+	memcpy(trace->ids, p, header.num_ops * sizeof(uint32_t));
+	p += header.num_ops * sizeof(uint32_t);
+	memcpy(trace->types, p, header.num_ops);
+	for (size_t i = 0; i < trace->num_ops; i++) {
+		if (trace->ids[i] >= trace->num_ids) {
+			trace->num_ids = (size_t)trace->ids[i] + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Load a text or binary trace file.
+ *
+ * @param path the trace file
+ * @return the trace, or NULL with errno set if the file cannot be read or is malformed
+ */
+Trace *trace_load(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (text == MAP_FAILED) {
+		return NULL;
+	}
+	madvise(text, st.st_size, MADV_SEQUENTIAL);
+
+	Trace *trace = calloc(1, sizeof(Trace));
+	int error = (trace == NULL) ? ENOMEM : 0;
+	if (error == 0 && (size_t)st.st_size >= sizeof(TraceHeader)
+			&& memcmp(text, TRACE_MAGIC, sizeof(((TraceHeader *)0)->magic)) == 0) {
+		error = load_binary(trace, text, st.st_size);
+	} else if (error == 0) {
+		Cursor c = { text, text + st.st_size };
+		uint64_t heapsize, ids, ops, weight;
+		if (!read_number(&c, &heapsize) || !read_number(&c, &ids)
+			|| !read_number(&c, &ops) || !read_number(&c, &weight)) {
+			error = EINVAL;
+		} else {
+			trace->header_ids = trace->num_ids = ids;
+			trace->header_ops = ops;
+			trace->heapsize = heapsize;
+			trace->weight = weight;
+			if (ops > (uint64_t)st.st_size / 4) {
+				ops = st.st_size / 4;               /* an op takes at least 4 characters */
+			}
+			if (ops > 0 && !resize_ops(trace, ops)) {
+				error = ENOMEM;
+			} else {
+				error = parse_ops(trace, &c, ops);
+			}
+		}
+	}
+	munmap(text, st.st_size);
+	if (error != 0) {
+		trace_free(trace);
+		errno = error;
+		return NULL;
+	}
+	return trace;
+}
+
+/**
+ * Write all of a buffer.
+ * @param fd the file
+ * @param data the buffer
+ * @param len the bytes in the buffer
+ * @return true if all was written
+ */
+static bool write_all(int fd, const void *data, size_t len) {
+	const char *p = data;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+ * Write a trace in the binary format.
+ *
+ * @param trace the trace
+ * @param path the file to write
+ * @return 0 if successful, -1 with errno set if not
+ */
+int trace_save(const Trace *trace, const char *path) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	TraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.heapsize = trace->heapsize;
+	header.num_ids = trace->num_ids;
+	header.num_ops = trace->num_ops;
+	header.weight = trace->weight;
+	bool ok = write_all(fd, &header, sizeof(header))
+			&& write_all(fd, trace->sizes, trace->num_ops * sizeof(size_t))
+			&& write_all(fd, trace->ids, trace->num_ops * sizeof(uint32_t))
+			&& write_all(fd, trace->types, trace->num_ops);
+	if (close(fd) != 0) {
+		ok = false;
+	}
+	return ok ? 0 : -1;
+}
+
+/**
+ * Free a trace loaded by trace_load.
+ *
+ * @param trace the trace, or NULL
+ */
+void trace_free(Trace *trace) {
+	if (trace != NULL) {
+		free(trace->types);
+		free(trace->ids);
+		free(trace->sizes);
+		free(trace);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ * trace.h - heap request traces, loaded into memory before they are
+ *           replayed so that parsing is not part of the replay.
+ *
+ * A trace file starts with four numbers: the suggested heap size, the
+ * number of block ids, the number of ops, and a weight. Each op is then
+ * "a <id> <size>", "r <id> <size>" or "f <id>". The ops are kept as
+ * parallel arrays so that a replay streams through them in order.
+ *
+ * A binary trace, written by trace_save, starts with TRACE_MAGIC and a
+ * TraceHeader, followed by the sizes, ids and types arrays in host byte
+ * order. It loads without parsing, which matters for very long traces.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Op types in a trace */
+#define TRACE_ALLOC 'a'
+#define TRACE_REALLOC 'r'
+#define TRACE_FREE 'f'
+
+/** Magic number at the start of a binary trace */
+#define TRACE_MAGIC "MMTRACE1"
+
+/** Header of a binary trace */
+typedef struct {
+	char magic[8];          /* TRACE_MAGIC */
+	uint64_t heapsize;      /* suggested heap size */
+	uint64_t num_ids;       /* block ids used */
+	uint64_t num_ops;       /* ops that follow */
+	uint64_t weight;        /* weight of the trace */
+} TraceHeader;
+
+/** A trace loaded into memory */
+typedef struct {
+	size_t num_ids;         /* block ids used, one more than the largest */
+	size_t num_ops;         /* ops in the trace */
+	size_t header_ids;      /* block ids given by the trace header */
+	size_t header_ops;      /* ops given by the trace header */
+	size_t heapsize;        /* suggested heap size given by the trace header */
+	size_t weight;          /* weight given by the trace header */
+	char *types;            /* type of each op, possibly not one of the TRACE_ types */
+	uint32_t *ids;          /* block id of each op */
+	size_t *sizes;          /* bytes requested by each op, 0 for a free */
+} Trace;
+
+/**
+ * Load a text or binary trace file.
+ *
+ * @param path the trace file
+ * @return the trace, or NULL with errno set if the file cannot be read or is malformed
+ */
+Trace *trace_load(const char *path);
+
+/**
+ * Write a trace in the binary format.
+ *
+ * @param trace the trace
+ * @param path the file to write
+ * @return 0 if successful, -1 with errno set if not
+ */
+int trace_save(const Trace *trace, const char *path);
+
+/**
+ * Free a trace loaded by trace_load.
+ *
+ * @param trace the trace, or NULL
+ */
+void trace_free(Trace *trace);
+
+#endif /* TRACE_H_ */
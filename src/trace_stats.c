@@ -0,0 +1,425 @@
+/*
+ * trace_stats.c - describe the workload of heap request traces
+ *
+ * Prints, for each text or binary trace, the op counts, a histogram of
+ * the requested sizes, the distribution of block lifetimes in ops, the
+ * realloc growth chains, a curve of the live bytes over the trace, and
+ * the peak live payload. No heap can replay a trace in fewer bytes than
+ * its peak live payload, so that is the lower bound that the util% of
+ * test_heap (peak live payload / peak heap) rates a heap against.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "trace.h"
+
+/** Power of two buckets of a histogram, enough for any 64-bit value */
+#define BUCKETS 65
+
+/** Default number of points on the live bytes curve */
+#define CURVE_POINTS 32
+
+/** Characters in the longest bar */
+#define BAR_WIDTH 40
+
+/** A histogram; bucket b counts values in [2^(b-1), 2^b), bucket 0 the value 0 */
+typedef struct {
+	uint64_t counts[BUCKETS];
+	uint64_t total;                 /* values counted */
+	uint64_t sum;                   /* sum of the values */
+} Histogram;
+
+/** What is known about a block id while the trace is read */
+typedef struct {
+	bool live;
+	size_t birth;                   /* op that allocated the block */
+	size_t size;                    /* bytes requested now */
+	size_t first;                   /* bytes requested when allocated */
+	uint32_t reallocs;              /* reallocs since allocated */
+} Block;
+
+/** Statistics of a trace */
+typedef struct {
+	uint64_t allocs, reallocs, frees, invalid;
+	Histogram alloc_sizes;          /* bytes requested by allocs */
+	Histogram realloc_sizes;        /* bytes requested by reallocs */
+	Histogram lifetimes;            /* ops from alloc to free of freed blocks */
+	Histogram chains;               /* reallocs of blocks reallocated at least once */
+	uint64_t grew, shrank;          /* chains ending larger or smaller than they started */
+	double growth;                  /* sum over chains of last size / first size */
+	uint64_t longest;               /* most reallocs of one block */
+	uint64_t unfreed;               /* blocks never freed */
+	size_t unfreed_bytes;
+	size_t live, peak;              /* live payload now and at its peak */
+	uint64_t live_blocks, peak_blocks;
+	size_t peak_op;                 /* op at which the peak was reached */
+	size_t *curve;                  /* peak live payload within each part of the trace */
+	int points;                     /* parts of the trace in the curve */
+} TraceStats;
+
+/**
+ * usage - Explain the command line arguments
+ */
+static void usage(void) {
+    fprintf(stderr, "Usage: trace_stats [-h] [-p <points>] [-b <file>] <file1> [...<file>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-p <points> Points on the live bytes curve (default %d).\n", CURVE_POINTS);
+    fprintf(stderr, "\t-b <file>   Write the trace in binary to <file>; one trace only.\n");
+    fprintf(stderr, "\t<file>      Text or binary trace file.\n");
+}
+
+/**
+ * Find the bucket of a value.
+ * @param v the value
+ * @return the bucket
+ */
+static int bucket_of(uint64_t v) {
+	return (v == 0) ? 0 : 64 - __builtin_clzll(v);
+}
+
+/**
+ * Count a value.
+ * @param h the histogram
+ * @param v the value
+ */
+static void hist_add(Histogram *h, uint64_t v) {
+	int b = bucket_of(v);
+	h->counts[b]++;
+	h->total++;
+	h->sum += v;
+}
+
+/**
+ * Find the bucket holding a percentile of the values.
+ * @param h the histogram
+ * @param p the percentile, from 0 to 100
+ * @return the bucket
+ */
+static int hist_percentile(const Histogram *h, double p) {
+	uint64_t rank = (uint64_t)(p / 100.0 * h->total);
+	uint64_t seen = 0;
+	for (int b = 0; b < BUCKETS; b++) {
+		seen += h->counts[b];
+		if (seen > rank) {
+			return b;
+		}
+	}
+	return BUCKETS - 1;
+}
+
+/**
+ * Format a count of bytes or ops, with a K, M, G, T, P or E suffix
+ * if it is a multiple of a power of 1024.
+ * @param buf the buffer, at least 24 characters
+ * @param v the value
+ * @return the buffer
+ */
+static char *fmt_value(char *buf, uint64_t v) {
+	static const char suffixes[] = " KMGTPE";
+	int s = 0;
+	while (v >= 1024 && v % 1024 == 0 && s < 6) {
+		v /= 1024;
+		s++;
+	}
+	if (s == 0) {
+		snprintf(buf, 24, "%llu", (unsigned long long)v);
+	} else {
+		snprintf(buf, 24, "%llu%c", (unsigned long long)v, suffixes[s]);
+	}
+	return buf;
+}
+
+/**
+ * Format the range of values of a bucket as "low-high",
+ * the high end excluded.
+ * @param buf the buffer, at least 56 characters
+ * @param b the bucket
+ * @return the buffer
+ */
+static char *fmt_bucket(char *buf, int b) {
+	char lo[24], hi[24];
+	if (b <= 1) {
+		snprintf(buf, 56, "%d", b);
+	} else if (b < 64) {
+		snprintf(buf, 56, "%s-%s", fmt_value(lo, (uint64_t)1 << (b-1)), fmt_value(hi, (uint64_t)1 << b));
+	} else {
+		snprintf(buf, 56, "%s-", fmt_value(lo, (uint64_t)1 << (b-1)));
+	}
+	return buf;
+}
+
+/**
+ * Make a bar of a share of the longest bar.
+ * @param buf the buffer, at least BAR_WIDTH+1 characters
+ * @param v the value
+ * @param max the value of the longest bar
+ * @return the buffer
+ */
+static char *bar(char *buf, double v, double max) {
+	int n = (max > 0) ? (int)(v / max * BAR_WIDTH + 0.5) : 0;
+	if (n == 0 && v > 0) {
+		n = 1;
+	}
+	memset(buf, '#', n);
+	buf[n] = '\0';
+	return buf;
+}
+
+/**
+ * Print a histogram, one line per bucket from the first to the last used.
+ * @param title the heading
+ * @param unit what the values count
+ * @param h the histogram
+ * @param other a second histogram to print beside it, or NULL
+ * @param other_name the column name of the second histogram
+ */
+static void print_hist(const char *title, const char *unit, const Histogram *h,
+		const Histogram *other, const char *other_name) {
+	int first = BUCKETS, last = -1;
+	uint64_t max = 0;
+	for (int b = 0; b < BUCKETS; b++) {
+		uint64_t n = h->counts[b] + (other ? other->counts[b] : 0);
+		if (n > 0) {
+			first = (b < first) ? b : first;
+			last = b;
+			max = (h->counts[b] > max) ? h->counts[b] : max;
+		}
+	}
+	printf("%s\n", title);
+	if (last < 0) {
+		printf("  none\n");
+		return;
+	}
+	printf("%16s%12s", unit, "count");
+	if (other) printf("%12s", other_name);
+	printf("%8s\n", "cum%");
+	uint64_t seen = 0;
+	for (int b = first; b <= last; b++) {
+		char range[56], line[BAR_WIDTH+1];
+		seen += h->counts[b];
+		printf("%16s%12llu", fmt_bucket(range, b), (unsigned long long)h->counts[b]);
+		if (other) printf("%12llu", (unsigned long long)other->counts[b]);
+		printf("%8.1f  %s\n", h->total ? 100.0 * seen / h->total : 0.0, bar(line, h->counts[b], max));
+	}
+}
+
+/**
+ * Count the realloc chain of a block that is freed or left at the end.
+ * @param stats the statistics of the trace
+ * @param b the block
+ */
+static void end_chain(TraceStats *stats, const Block *b) {
+	if (b->reallocs == 0) {
+		return;
+	}
+	hist_add(&stats->chains, b->reallocs);
+	stats->grew += (b->size > b->first);
+	stats->shrank += (b->size < b->first);
+	stats->growth += (b->first > 0) ? (double)b->size / b->first : 1;
+	if (b->reallocs > stats->longest) {
+		stats->longest = b->reallocs;
+	}
+}
+
+/**
+ * Read the ops of a trace.
+ * @param stats set to the statistics of the trace
+ * @param trace the trace
+ * @param points the points on the live bytes curve
+ * @return true if there was memory for the block ids
+ */
+static bool analyze(TraceStats *stats, const Trace *trace, int points) {
+	memset(stats, 0, sizeof(*stats));
+	Block *blocks = calloc(trace->num_ids, sizeof(Block));
+	stats->curve = calloc(points, sizeof(size_t));
+	if ((blocks == NULL && trace->num_ids > 0) || stats->curve == NULL) {
+		free(blocks);
+		free(stats->curve);
+		return false;
+	}
+	stats->points = points;
+	size_t interval = (trace->num_ops + points - 1) / points;
+	if (interval == 0) {
+		interval = 1;
+	}
+
+	for (size_t i = 0; i < trace->num_ops; i++) {
+		Block *b = &blocks[trace->ids[i]];
+		size_t size = trace->sizes[i];
+		switch (trace->types[i]) {
+		case TRACE_ALLOC:
+			if (b->live) {
+				stats->invalid++;
+				break;
+			}
+			b->live = true;
+			b->birth = i;
+			b->size = b->first = size;
+			b->reallocs = 0;
+			stats->allocs++;
+			stats->live += size;
+			stats->live_blocks++;
+			hist_add(&stats->alloc_sizes, size);
+			break;
+		case TRACE_REALLOC:
+			if (!b->live) {
+				stats->invalid++;
+				break;
+			}
+			stats->reallocs++;
+			stats->live += size - b->size;
+			b->size = size;
+			b->reallocs++;
+			hist_add(&stats->realloc_sizes, size);
+			break;
+		case TRACE_FREE:
+			if (!b->live) {
+				stats->invalid++;
+				break;
+			}
+			stats->frees++;
+			stats->live -= b->size;
+			stats->live_blocks--;
+			hist_add(&stats->lifetimes, i - b->birth);
+			end_chain(stats, b);
+			b->live = false;
+			break;
+		default:
+			stats->invalid++;
+			break;
+		}
+		if (stats->live > stats->peak) {
+			stats->peak = stats->live;
+			stats->peak_blocks = stats->live_blocks;
+			stats->peak_op = i;
+		}
+		size_t *point = &stats->curve[i / interval];
+		if (stats->live > *point) {
+			*point = stats->live;
+		}
+	}
+
+	for (size_t id = 0; id < trace->num_ids; id++) {
+		Block *b = &blocks[id];
+		if (!b->live) {
+			continue;
+		}
+		stats->unfreed++;
+		stats->unfreed_bytes += b->size;
+		end_chain(stats, b);
+	}
+	free(blocks);
+	return true;
+}
+
+/**
+ * Print the statistics of a trace.
+ * @param name the trace file
+ * @param trace the trace
+ * @param stats the statistics
+ */
+static void print_stats(const char *name, const Trace *trace, const TraceStats *stats) {
+	char lo[56], hi[56], line[BAR_WIDTH+1];
+	printf("%s: %zu ops (%llu allocs, %llu reallocs, %llu frees, %llu invalid), %zu ids\n",
+			name, trace->num_ops, (unsigned long long)stats->allocs, (unsigned long long)stats->reallocs,
+			(unsigned long long)stats->frees, (unsigned long long)stats->invalid, trace->num_ids);
+
+	printf("\n");
+	print_hist("Requested sizes:", "bytes", &stats->alloc_sizes, &stats->realloc_sizes, "reallocs");
+	if (stats->alloc_sizes.total > 0) {
+		printf("  mean alloc %.1f bytes\n", (double)stats->alloc_sizes.sum / stats->alloc_sizes.total);
+	}
+
+	printf("\n");
+	print_hist("Lifetimes of freed blocks:", "ops", &stats->lifetimes, NULL, NULL);
+	const Histogram *l = &stats->lifetimes;
+	if (l->total > 0) {
+		printf("  mean %.1f ops, median in %s, p90 in %s\n", (double)l->sum / l->total,
+				fmt_bucket(lo, hist_percentile(l, 50)), fmt_bucket(hi, hist_percentile(l, 90)));
+	}
+	printf("  %llu blocks, %zu bytes never freed\n", (unsigned long long)stats->unfreed, stats->unfreed_bytes);
+
+	printf("\n");
+	print_hist("Realloc chains:", "reallocs", &stats->chains, NULL, NULL);
+	if (stats->chains.total > 0) {
+		printf("  %llu grew, %llu shrank, mean last/first size %.2f, longest %llu reallocs\n",
+				(unsigned long long)stats->grew, (unsigned long long)stats->shrank,
+				stats->growth / stats->chains.total, (unsigned long long)stats->longest);
+	}
+
+	printf("\nLive bytes over the trace:\n");
+	printf("%16s%12s\n", "op", "peakKB");
+	size_t interval = (trace->num_ops + stats->points - 1) / stats->points;
+	for (int p = 0; p < stats->points && (size_t)p * interval < trace->num_ops; p++) {
+		printf("%16zu%12.1f  %s\n", (size_t)p * interval, stats->curve[p] / 1024.0,
+				bar(line, stats->curve[p], stats->peak));
+	}
+
+	printf("\nPeak live payload %zu bytes (%.1f KB) in %llu blocks at op %zu\n",
+			stats->peak, stats->peak / 1024.0, (unsigned long long)stats->peak_blocks, stats->peak_op);
+	printf("Lower bound on heap size %zu bytes; the trace suggests %zu\n\n", stats->peak, trace->heapsize);
+}
+
+/**
+ * Program describes heap request traces.
+ * @param argc the argument count
+ * @param argv the argument array
+ */
+int main(int argc, char *argv[]) {
+	int c;
+	int points = CURVE_POINTS;
+	char *binary_file = NULL;
+	while ((c = getopt(argc, argv, "hp:b:")) != EOF) {
+		switch (c) {
+		case 'p': /* Points on the live bytes curve */
+			points = atoi(optarg);
+			if (points <= 0) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b': /* Write the trace in binary */
+			binary_file = optarg;
+			break;
+		case 'h': /* Print this message */
+			usage();
+			return EXIT_SUCCESS;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc || (binary_file != NULL && optind != argc - 1)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	for (int index = optind; index < argc; index++) {
+		Trace *trace = trace_load(argv[index]);
+		if (trace == NULL) {
+			fprintf(stderr, "Cannot read trace file: %s\n", argv[index]);
+			status = EXIT_FAILURE;
+			continue;
+		}
+		TraceStats stats;
+		if (!analyze(&stats, trace, points)) {
+			fprintf(stderr, "No memory for the %zu ids of trace %s\n", trace->num_ids, argv[index]);
+			status = EXIT_FAILURE;
+		} else {
+			print_stats(argv[index], trace, &stats);
+			free(stats.curve);
+		}
+		if (binary_file != NULL && trace_save(trace, binary_file) != 0) {
+			fprintf(stderr, "Cannot write binary trace %s\n", binary_file);
+			status = EXIT_FAILURE;
+		}
+		trace_free(trace);
+	}
+	return status;
+}